@@ -0,0 +1,92 @@
+#include "accel.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ACCEL_X86 1
+#include <immintrin.h>
+#endif
+
+// Build ranges from a 256-entry membership mask; false if it needs too many ranges
+bool makeByteRanges(const bool member[256], ByteRanges &out) {
+    out.count = 0;
+    for (int b = 0; b < 256;) {
+        if (!member[b]) { ++b; continue; }
+        int e = b;
+        while (e + 1 < 256 && member[e + 1]) ++e;
+        if (out.count == ACCEL_MAX_RANGES) return false;
+        out.lo[out.count] = (uint8_t)b;
+        out.hi[out.count] = (uint8_t)e;
+        ++out.count;
+        b = e + 1;
+    }
+    return out.count > 0;
+}
+
+static size_t scanRunScalar(const ByteRanges &r, const unsigned char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && r.contains(p[i])) ++i;
+    return i;
+}
+
+#ifdef ACCEL_X86
+// A byte x is inside [lo,hi] when (x - lo) wraps to at most (hi - lo): min_epu8 does the unsigned compare
+__attribute__((target("sse2")))
+static size_t scanRunSSE2(const ByteRanges &r, const unsigned char *p, size_t n) {
+    __m128i lo[ACCEL_MAX_RANGES], span[ACCEL_MAX_RANGES];
+    for (int k = 0; k < r.count; ++k) {
+        lo[k] = _mm_set1_epi8((char)r.lo[k]);
+        span[k] = _mm_set1_epi8((char)(uint8_t)(r.hi[k] - r.lo[k]));
+    }
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i in = _mm_setzero_si128();
+        for (int k = 0; k < r.count; ++k) {
+            __m128i d = _mm_sub_epi8(x, lo[k]);
+            in = _mm_or_si128(in, _mm_cmpeq_epi8(_mm_min_epu8(d, span[k]), d));
+        }
+        unsigned out = ~(unsigned)_mm_movemask_epi8(in) & 0xFFFFu;
+        if (out) return i + __builtin_ctz(out);
+    }
+    return i + scanRunScalar(r, p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scanRunAVX2(const ByteRanges &r, const unsigned char *p, size_t n) {
+    __m256i lo[ACCEL_MAX_RANGES], span[ACCEL_MAX_RANGES];
+    for (int k = 0; k < r.count; ++k) {
+        lo[k] = _mm256_set1_epi8((char)r.lo[k]);
+        span[k] = _mm256_set1_epi8((char)(uint8_t)(r.hi[k] - r.lo[k]));
+    }
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i in = _mm256_setzero_si256();
+        for (int k = 0; k < r.count; ++k) {
+            __m256i d = _mm256_sub_epi8(x, lo[k]);
+            in = _mm256_or_si256(in, _mm256_cmpeq_epi8(_mm256_min_epu8(d, span[k]), d));
+        }
+        uint32_t out = ~(uint32_t)_mm256_movemask_epi8(in);
+        if (out) return i + __builtin_ctz(out);
+    }
+    return i + scanRunSSE2(r, p + i, n - i);
+}
+#endif
+
+typedef size_t (*ScanRunFn)(const ByteRanges &, const unsigned char *, size_t);
+
+static ScanRunFn pickScanRun() {
+#ifdef ACCEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return scanRunAVX2;
+    if (__builtin_cpu_supports("sse2")) return scanRunSSE2;
+#endif
+    return scanRunScalar;
+}
+
+static const ScanRunFn g_scanRun = pickScanRun();
+
+size_t scanRun(const ByteRanges &r, const unsigned char *p, size_t n) {
+    // short runs are the common case at token ends; keep them off the vector path
+    if (n < 16) return scanRunScalar(r, p, n);
+    return g_scanRun(r, p, n);
+}
@@ -0,0 +1,28 @@
+#ifndef ACCEL_H
+#define ACCEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Up to ACCEL_MAX_RANGES inclusive byte ranges, e.g. [A-Za-z0-9_] is 4 ranges
+const int ACCEL_MAX_RANGES = 4;
+
+struct ByteRanges {
+    int count = 0;
+    uint8_t lo[ACCEL_MAX_RANGES] = {};
+    uint8_t hi[ACCEL_MAX_RANGES] = {};
+
+    bool contains(uint8_t b) const {
+        for (int r = 0; r < count; ++r) if ((uint8_t)(b - lo[r]) <= (uint8_t)(hi[r] - lo[r])) return true;
+        return false;
+    }
+};
+
+// Build ranges from a 256-entry membership mask; false if it needs too many ranges
+bool makeByteRanges(const bool member[256], ByteRanges &out);
+
+// Length of the run at p[0..n) whose bytes all fall inside r.
+// Uses AVX2 or SSE2 kernels when the CPU has them, scalar code otherwise.
+size_t scanRun(const ByteRanges &r, const unsigned char *p, size_t n);
+
+#endif // ACCEL_H
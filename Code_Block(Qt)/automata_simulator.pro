@@ -1,5 +1,10 @@
 QT += core widgets gui
-CONFIG += c++17
+CONFIG += c++17 thread
+
+# Runtime DFA provenance (provenance.h) is packed by default; uncomment one
+# to keep the full vectors or drop it
+# DEFINES += CODEBLOCK_PROVENANCE_FULL
+# DEFINES += CODEBLOCK_PROVENANCE_NONE
 
 TARGET = AutomataSimulator
 TEMPLATE = app
@@ -7,12 +12,48 @@ TEMPLATE = app
 SOURCES += main.cpp \
            nfa.cpp \
            dfa.cpp \
+           provenance.cpp \
+           parallel_subset.cpp \
+           incremental_subset.cpp \
+           accel.cpp \
+           sheng.cpp \
+           profile.cpp \
+           tagdfa.cpp \
+           minimize.cpp \
+           equiv.cpp \
+           lexspec.cpp \
+           utf8.cpp \
+           unicode_xid.cpp \
+           lazydfa.cpp \
+           nfasim.cpp \
+           counting.cpp \
+           planner.cpp \
+           dfaio.cpp \
            tokenizer.cpp \
            pda.cpp \
            mainwindow.cpp
 
 HEADERS += nfa.h \
            dfa.h \
+           provenance.h \
+           matcher.h \
+           parallel_subset.h \
+           incremental_subset.h \
+           accel.h \
+           sheng.h \
+           profile.h \
+           tagdfa.h \
+           minimize.h \
+           equiv.h \
+           lexspec.h \
+           utf8.h \
+           unicode_xid.h \
+           lazydfa.h \
+           nfasim.h \
+           counting.h \
+           planner.h \
+           dfaio.h \
+           static_dfa.h \
            tokenizer.h \
            pda.h \
            mainwindow.h
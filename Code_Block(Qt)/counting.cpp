@@ -0,0 +1,91 @@
+#include "counting.h"
+
+// Close out from the states on scratch.stack (already marked with g); the
+// exit edge of a counted loop is only taken when its counts allow it; acc
+// keeps the lowest accept tag seen
+static void closeCounting(const FlatNFA &n, CountingSet &out, uint32_t g, SubsetScratch &scratch, int &acc) {
+    while (!scratch.stack.empty()) {
+        int s = scratch.stack.back(); scratch.stack.pop_back();
+        out.states.push_back(s);
+        int a = n.acceptTag[s];
+        if (a >= 0 && (acc < 0 || a < acc)) acc = a;
+        int c = n.counterOf[s];
+        for (int e = n.epsStart[s]; e < n.epsStart[s + 1]; ++e) {
+            int nxt = n.epsTo[e];
+            if (c >= 0 && nxt == n.counters[c].exit && !(out.counts[c] & n.counters[c].exitMask)) continue;
+            if (scratch.mark[nxt] != g) { scratch.mark[nxt] = g; scratch.stack.push_back(nxt); }
+        }
+    }
+}
+
+void countingStart(const FlatNFA &n, CountingSet &out, SubsetScratch &scratch) {
+    out.states.clear();
+    out.counts.assign(n.counters.size(), 0);
+    if (n.start < 0) return;
+    uint32_t g = scratch.nextGen(n.numStates);
+    scratch.stack.clear();
+    scratch.mark[n.start] = g;
+    scratch.stack.push_back(n.start);
+    int acc = -1;
+    closeCounting(n, out, g, scratch, acc);
+}
+
+int countingStep(const FlatNFA &n, const CountingSet &cur, int b, CountingSet &out, SubsetScratch &scratch) {
+    uint32_t g = scratch.nextGen(n.numStates);
+    int acc = -1;
+    out.states.clear();
+    out.counts.assign(n.counters.size(), 0);
+    scratch.stack.clear();
+    scratch.active.clear();     // counters reached on b
+    // plain targets first; the counts of a loop are only final once every
+    // edge into it is seen, so loop states are closed afterwards
+    for (int s : cur.states) {
+        for (int r = n.rangeStart[s]; r < n.rangeStart[s + 1]; ++r) {
+            const NFARange &rg = n.ranges[r];
+            if (b < rg.lo || b > rg.hi) continue;
+            int c = n.counterOf[rg.to];
+            if (c >= 0) {
+                const FlatCounter &fc = n.counters[c];
+                uint64_t v = cur.counts[c];
+                uint64_t top = v & (fc.mask ^ (fc.mask >> 1));
+                uint64_t next = s != rg.to ? 1 : ((v << 1) | (fc.saturate ? top : 0)) & fc.mask;
+                if (next && !out.counts[c]) scratch.active.push_back(c);
+                out.counts[c] |= next;
+                continue;
+            }
+            if (scratch.mark[rg.to] == g) continue;
+            scratch.mark[rg.to] = g;
+            scratch.stack.push_back(rg.to);
+        }
+    }
+    closeCounting(n, out, g, scratch, acc);
+    for (int c : scratch.active) {
+        int q = n.counters[c].state;
+        if (scratch.mark[q] == g) continue;
+        scratch.mark[q] = g;
+        scratch.stack.push_back(q);
+        closeCounting(n, out, g, scratch, acc);
+    }
+    return acc;
+}
+
+int countingAcceptTag(const FlatNFA &n, const CountingSet &set) {
+    int best = -1;
+    for (int s : set.states) {
+        int a = n.acceptTag[s];
+        if (a >= 0 && (best < 0 || a < best)) best = a;
+    }
+    return best;
+}
+
+void countingKey(const CountingSet &set, NFASet &key) {
+    key.clear();
+    key.push_back((int)set.states.size());
+    key.insert(key.end(), set.states.begin(), set.states.end());
+    std::sort(key.begin() + 1, key.end());
+    for (uint64_t v : set.counts) {
+        if (!v) continue;
+        key.push_back((int)(uint32_t)v);
+        key.push_back((int)(uint32_t)(v >> 32));
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef COUNTING_H
+#define COUNTING_H
+
+#include "dfa.h"
+
+// Simulation of counted loops (repeatFrag) without expanding them. Every
+// configuration the loop state can be in, one per count, moves together on
+// the loop's character class, so their counts are kept as one bit vector per
+// counter: a byte in the class shifts it by one (dropping counts past max),
+// entering the loop sets bit 0, and the eps edge to exit is taken when any
+// count is at least min. x{1,20} stays three NFA states and a word instead
+// of twenty copies.
+
+// Live states of a counting NFA and the counts of each counted loop
+struct CountingSet {
+    NFASet states;                  // unsorted
+    std::vector<uint64_t> counts;   // per FlatNFA counter; 0 when its loop state is not live
+};
+
+// Closed start set of n (flattened with keepCounters)
+void countingStart(const FlatNFA &n, CountingSet &out, SubsetScratch &scratch);
+
+// Closed targets of cur on byte b (out.states empty: no match can go on);
+// returns their winning accept tag, -1 if none accepts
+int countingStep(const FlatNFA &n, const CountingSet &cur, int b, CountingSet &out, SubsetScratch &scratch);
+
+// Winning accept tag of a set (the lowest one), -1 if no member accepts
+int countingAcceptTag(const FlatNFA &n, const CountingSet &set);
+
+// Interning key of a set (NFASetTable): state count, sorted states, then the
+// two words of every live count
+void countingKey(const CountingSet &set, NFASet &key);
+
+#endif // COUNTING_H
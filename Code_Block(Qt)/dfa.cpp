@@ -1,128 +1,470 @@
 #include "dfa.h"
+#include "matcher.h"
+#include <bitset>
+#include <chrono>
+#include <unordered_set>
 
-// Epsilon closure
-std::set<int> epsClosure(const NFA &n, const std::set<int> &states) {
-    std::set<int> res = states;
-    std::vector<int> stvec(states.begin(), states.end());
-    while (!stvec.empty()) {
-        int s = stvec.back(); stvec.pop_back();
-        if (s < 0 || s >= (int)n.states.size()) continue;
-        for (int nxt : n.states[s].eps) {
-            if (!res.count(nxt)) { res.insert(nxt); stvec.push_back(nxt); }
+// Labeled edges of st as (target, byte) pairs, sorted
+static void sortedLabels(const NFAState &st, std::vector<std::pair<int,int>> &out) {
+    out.clear();
+    for (const auto &kv : st.trans)
+        for (int t : kv.second) out.push_back({ t, (unsigned char)kv.first });
+    std::sort(out.begin(), out.end());
+}
+
+// Byte equivalence classes: refine one partition by every (state, target) label set
+int computeByteClasses(const NFA &n, std::array<uint8_t, 256> &classOf) {
+    std::vector<int> cls(256, 0);
+    int count = 1;
+    std::unordered_set<std::bitset<256>> applied; // a label set splits nothing the second time
+    std::vector<std::pair<int,int>> labels;
+    for (const NFAState &st : n.states) {
+        sortedLabels(st, labels);
+        for (size_t i = 0; i < labels.size();) {
+            std::bitset<256> set;
+            int target = labels[i].first;
+            for (; i < labels.size() && labels[i].first == target; ++i) set.set(labels[i].second);
+            if (!applied.insert(set).second) continue;
+            // split every class into its members inside / outside the label set
+            std::vector<int> inside(count, -1), outside(count, -1);
+            int next = 0;
+            for (int b = 0; b < 256; ++b) {
+                int &slot = set.test(b) ? inside[cls[b]] : outside[cls[b]];
+                if (slot < 0) slot = next++;
+                cls[b] = slot;
+            }
+            count = next;
         }
     }
-    return res;
+    for (int b = 0; b < 256; ++b) classOf[b] = (uint8_t)cls[b];
+    return count;
 }
 
-// Move on char
-std::set<int> moveOnChar(const NFA &n, const std::set<int> &states, char c) {
-    std::set<int> res;
-    for (int s : states) {
-        if (s < 0 || s >= (int)n.states.size()) continue;
-        auto it = n.states[s].trans.find(c);
-        if (it != n.states[s].trans.end()) {
-            for (int nxt : it->second) res.insert(nxt);
+// NFA flattened for determinization
+FlatNFA flattenNFA(const NFA &n, bool keepCounters) {
+    if (!keepCounters && !n.counterOf.empty()) return flattenNFA(expandCounters(n));
+    FlatNFA f;
+    f.numStates = (int)n.states.size();
+    f.start = n.start;
+    f.alphabet = computeByteClasses(n, f.classOf);
+    f.classRep.assign(f.alphabet, -1);
+    for (int b = 255; b >= 0; --b) f.classRep[f.classOf[b]] = b;
+
+    f.epsStart.assign(f.numStates + 1, 0);
+    f.rangeStart.assign(f.numStates + 1, 0);
+    std::vector<std::pair<int,int>> labels;
+    for (int s = 0; s < f.numStates; ++s) {
+        const NFAState &st = n.states[s];
+        f.epsStart[s + 1] = f.epsStart[s] + (int)st.eps.size();
+        f.epsTo.insert(f.epsTo.end(), st.eps.begin(), st.eps.end());
+        // labels grouped per target, then maximal runs of consecutive bytes
+        sortedLabels(st, labels);
+        for (size_t i = 0; i < labels.size();) {
+            size_t e = i;
+            while (e + 1 < labels.size() && labels[e + 1].first == labels[i].first
+                   && labels[e + 1].second == labels[e].second + 1) ++e;
+            f.ranges.push_back({ (uint8_t)labels[i].second, (uint8_t)labels[e].second, labels[i].first });
+            i = e + 1;
         }
+        f.rangeStart[s + 1] = (int)f.ranges.size();
+    }
+    f.classesByRep.resize(f.alphabet);
+    for (int c = 0; c < f.alphabet; ++c) f.classesByRep[c] = c;
+    std::sort(f.classesByRep.begin(), f.classesByRep.end(),
+              [&f](int a, int b) { return f.classRep[a] < f.classRep[b]; });
+    f.acceptTag.assign(f.numStates, -1);
+    for (int a : n.accepts) {
+        auto t = n.acceptTag.find(a);
+        f.acceptTag[a] = t == n.acceptTag.end() ? 0 : t->second;
+    }
+    f.tagOf.assign(f.numStates, -1);
+    for (const auto &kv : n.tagOf) f.tagOf[kv.first] = kv.second;
+    f.numTags = nfaTagCount(n);
+    f.counterOf.assign(f.numStates, -1);
+    for (const auto &kv : n.counterOf) {
+        const NFACounter &c = kv.second;
+        int len = c.max < 0 ? c.min : c.max;
+        FlatCounter fc;
+        fc.state = kv.first;
+        fc.exit = c.exit;
+        fc.mask = len >= 64 ? ~0ull : (1ull << len) - 1;
+        fc.exitMask = fc.mask & ~((1ull << (c.min - 1)) - 1);
+        fc.saturate = c.max < 0;
+        f.counterOf[kv.first] = (int)f.counters.size();
+        f.counters.push_back(fc);
+    }
+    return f;
+}
+
+uint32_t SubsetScratch::nextGen(int numStates) {
+    if ((int)mark.size() < numStates) mark.resize(numStates, 0);
+    if (++gen == 0) { std::fill(mark.begin(), mark.end(), 0); gen = 1; }
+    return gen;
+}
+
+// In-place epsilon closure of a set; the result is sorted
+void epsClosureInto(const FlatNFA &n, NFASet &set, SubsetScratch &scratch) {
+    uint32_t g = scratch.nextGen(n.numStates);
+    scratch.stack.clear();
+    for (int s : set) { scratch.mark[s] = g; scratch.stack.push_back(s); }
+    while (!scratch.stack.empty()) {
+        int s = scratch.stack.back(); scratch.stack.pop_back();
+        for (int e = n.epsStart[s]; e < n.epsStart[s + 1]; ++e) {
+            int nxt = n.epsTo[e];
+            if (scratch.mark[nxt] != g) { scratch.mark[nxt] = g; set.push_back(nxt); scratch.stack.push_back(nxt); }
+        }
+    }
+    std::sort(set.begin(), set.end());
+}
+
+// Targets of the set on byte class c (not closed, sorted)
+void moveOnClassInto(const FlatNFA &n, const NFASet &set, int c, NFASet &out, SubsetScratch &scratch) {
+    uint32_t g = scratch.nextGen(n.numStates);
+    out.clear();
+    const int rep = n.classRep[c];
+    for (int s : set) {
+        for (int r = n.rangeStart[s]; r < n.rangeStart[s + 1]; ++r) {
+            const NFARange &rg = n.ranges[r];
+            if (rep < rg.lo || rep > rg.hi) continue;
+            if (scratch.mark[rg.to] != g) { scratch.mark[rg.to] = g; out.push_back(rg.to); }
+        }
+    }
+    std::sort(out.begin(), out.end());
+}
+
+// 64-bit fingerprint of an NFA set
+uint64_t hashNFASet(const NFASet &s) {
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ (uint64_t)s.size();
+    for (int x : s) {
+        h ^= (uint64_t)(uint32_t)x + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+    }
+    // splitmix64 finalizer spreads the low bits used for slot selection
+    h ^= h >> 30; h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27; h *= 0x94D049BB133111EBull;
+    h ^= h >> 31;
+    return h;
+}
+
+int NFASetTable::intern(const NFASet &s, bool *added) {
+    if (m_slots.size() < 2 * (m_sets.size() + 1)) rehash(std::max<size_t>(64, m_slots.size() * 2));
+    uint64_t h = hashNFASet(s);
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        int id = m_slots[i];
+        if (id < 0) {
+            id = (int)m_sets.size();
+            m_slots[i] = id;
+            m_sets.push_back(s);
+            m_hash.push_back(h);
+            if (added) *added = true;
+            return id;
+        }
+        if (m_hash[id] == h && m_sets[id] == s) {
+            if (added) *added = false;
+            return id;
+        }
+    }
+}
+
+int NFASetTable::find(const NFASet &s) const {
+    if (m_slots.empty()) return -1;
+    uint64_t h = hashNFASet(s);
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        int id = m_slots[i];
+        if (id < 0) return -1;
+        if (m_hash[id] == h && m_sets[id] == s) return id;
+    }
+}
+
+void NFASetTable::rehash(size_t slots) {
+    m_slots.assign(slots, -1);
+    size_t mask = slots - 1;
+    for (int id = 0; id < (int)m_sets.size(); ++id) {
+        size_t i = m_hash[id] & mask;
+        while (m_slots[i] >= 0) i = (i + 1) & mask;
+        m_slots[i] = id;
+    }
+}
+
+std::vector<NFASet> NFASetTable::release() {
+    std::vector<NFASet> out;
+    out.swap(m_sets);
+    clear();
+    return out;
+}
+
+void NFASetTable::clear() {
+    m_sets.clear();
+    m_hash.clear();
+    m_slots.clear();
+}
+
+// Winning accept tag of a set (the lowest one), -1 if no member accepts
+int subsetAcceptTag(const FlatNFA &n, const NFASet &set) {
+    int acc = -1;
+    for (int s : set) {
+        int tag = n.acceptTag[s];
+        if (tag >= 0 && (acc < 0 || tag < acc)) acc = tag;
     }
-    return res;
+    return acc;
 }
 
-// Subset construction (NFA -> DFA) with reachable pruning
+// Transitions of one DFA state by an interval sweep over its outgoing labels
+void expandSubsetState(const FlatNFA &n, const NFASet &set, SubsetScratch &scratch, SubsetRow &row) {
+    row.count = 0;
+    row.cls.clear();
+    row.target.clear();
+    if ((int)scratch.live.size() < n.numStates) scratch.live.assign(n.numStates, 0);
+    scratch.events.clear();
+    for (int s : set) {
+        for (int r = n.rangeStart[s]; r < n.rangeStart[s + 1]; ++r) {
+            const NFARange &rg = n.ranges[r];
+            scratch.events.push_back({ rg.lo, rg.to + 1 });
+            scratch.events.push_back({ rg.hi + 1, -(rg.to + 1) });
+        }
+    }
+    std::sort(scratch.events.begin(), scratch.events.end());
+    scratch.active.clear();
+    auto dropDead = [&scratch]() {
+        size_t keep = 0;
+        for (int to : scratch.active) if (scratch.live[to] > 0) scratch.active[keep++] = to;
+        scratch.active.resize(keep);
+    };
+    size_t nextClass = 0;
+    for (size_t e = 0; e < scratch.events.size();) {
+        int lo = scratch.events[e].first;
+        // removals sort first; a target whose range ends at lo and another
+        // member's range to it starts there must not be added twice, so the
+        // dead ones are dropped before the first addition
+        bool dropped = false;
+        for (; e < scratch.events.size() && scratch.events[e].first == lo; ++e) {
+            int to = std::abs(scratch.events[e].second) - 1;
+            if (scratch.events[e].second < 0) { --scratch.live[to]; continue; }
+            if (!dropped) { dropDead(); dropped = true; }
+            if (scratch.live[to]++ == 0) scratch.active.push_back(to);
+        }
+        if (e == scratch.events.size()) break;
+        int hi = scratch.events[e].first - 1;
+
+        // targets live on [lo, hi]
+        if (!dropped) dropDead();
+        if (scratch.active.empty()) continue;
+        scratch.moved.assign(scratch.active.begin(), scratch.active.end());
+        std::sort(scratch.moved.begin(), scratch.moved.end());
+        // neighbouring intervals with the same targets share one closure
+        if (row.count == 0 || scratch.moved != scratch.lastTargets) {
+            scratch.lastTargets = scratch.moved;
+            if ((int)row.targets.size() == row.count) row.targets.emplace_back();
+            NFASet &t = row.targets[row.count++];
+            t = scratch.moved;
+            epsClosureInto(n, t, scratch);
+        }
+        // every class whose representative falls in [lo, hi] takes this target
+        while (nextClass < n.classesByRep.size() && n.classRep[n.classesByRep[nextClass]] < lo) ++nextClass;
+        for (; nextClass < n.classesByRep.size() && n.classRep[n.classesByRep[nextClass]] <= hi; ++nextClass) {
+            row.cls.push_back(n.classesByRep[nextClass]);
+            row.target.push_back(row.count - 1);
+        }
+    }
+    for (int to : scratch.active) scratch.live[to] = 0;
+}
+
+// Subset construction (NFA -> DFA)
 DFA subsetConstruction(const NFA &n) {
+    auto t0 = std::chrono::steady_clock::now();
+    FlatNFA f = flattenNFA(n);
     DFA d;
-    std::set<int> startSet = epsClosure(n, { n.start });
-    d.mapping[startSet] = 0;
-    d.rev.push_back(startSet);
-    d.trans.emplace_back();
-
-    for (size_t i = 0; i < d.rev.size(); ++i) {
-        auto curSet = d.rev[i];
-        // mark accept
-        for (int a : n.accepts) if (curSet.count(a)) { d.accepts.insert((int)i); break; }
-        // consider all possible input chars (only ASCII subset 0..127)
-        for (int c = 0; c < 128; ++c) {
-            char ch = (char)c;
-            auto moved = moveOnChar(n, curSet, ch);
-            if (moved.empty()) continue;
-            auto epsed = epsClosure(n, moved);
-            if (!epsed.empty()) {
-                if (!d.mapping.count(epsed)) {
-                    int id = (int)d.rev.size();
-                    d.mapping[epsed] = id;
-                    d.rev.push_back(epsed);
-                    d.trans.emplace_back();
-                }
-                d.trans[i][ch] = d.mapping[epsed];
-            }
+    d.classOf = f.classOf;
+    d.alphabet = f.alphabet;
+    // an empty NFA matches nothing: no states, as NFASimulator treats it
+    if (n.start < 0) return d;
+
+    NFASetTable sets;
+    SubsetScratch scratch;
+    SubsetRow row;
+    NFASet cur;
+    std::vector<int> ids;
+    std::vector<int> accepting; // per discovered state: winning tag, -1 if not accepting
+
+    cur.push_back(n.start);
+    epsClosureInto(f, cur, scratch);
+    sets.intern(cur);
+    d.table.assign(d.alphabet, DFA_DEAD);
+
+    for (int i = 0; i < sets.size(); ++i) {
+        cur = sets.at(i); // reuses cur's buffer
+        // mark accept, keeping the lowest tag when several token NFAs accept here
+        accepting.push_back(subsetAcceptTag(f, cur));
+        expandSubsetState(f, cur, scratch, row);
+        ids.resize(row.count);
+        for (int k = 0; k < row.count; ++k) {
+            bool added = false;
+            ids[k] = sets.intern(row.targets[k], &added);
+            if (added) d.table.resize(d.table.size() + d.alphabet, DFA_DEAD);
         }
+        for (size_t j = 0; j < row.cls.size(); ++j)
+            d.table[(size_t)i * d.alphabet + row.cls[j]] = ids[row.target[j]];
     }
 
-    // reachable-state pruning from d.start (0)
-    std::vector<char> seen(d.rev.size(), 0);
-    std::vector<int> q; q.push_back(d.start); seen[d.start] = 1;
-    for (size_t idx = 0; idx < q.size(); ++idx) {
-        int u = q[idx];
-        for (auto &kv : d.trans[u]) {
-            int v = kv.second;
-            if (!seen[v]) { seen[v] = 1; q.push_back(v); }
+    d.numStates = sets.size();
+    d.start = 0;
+    d.rev = sets.release();
+    d.acceptBits.assign((d.numStates + 63) / 64, 0);
+    d.acceptTag = accepting;
+    for (int id = 0; id < d.numStates; ++id)
+        if (accepting[id] >= 0) d.acceptBits[id >> 6] |= 1ull << (id & 63);
+    d.stats.nfaStates = f.numStates;
+    d.stats.statesBefore = d.stats.statesAfter = d.numStates;
+    packDFA(d);
+    d.stats.subsetMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return d;
+}
+
+DFAView DFA::view() const {
+    DFAView v;
+    v.numStates = numStates;
+    v.alphabet = alphabet;
+    v.start = start;
+    v.classOf = classOf.data();
+    v.table16 = table16.empty() ? nullptr : table16.data();
+    v.table = table.empty() ? nullptr : table.data();
+    v.acceptBits = acceptBits.data();
+    v.acceptTag = acceptTag.data();
+    v.accelIndex = accelIndex.data();
+    v.accel = accel.data();
+    v.numAccel = (int)accel.size();
+    v.sheng = sheng.empty() ? nullptr : sheng.data();
+    v.lookahead = lookahead;
+    v.numTags = numTags;
+    v.tagSet = tagSet.empty() ? nullptr : tagSet.data();
+    v.tagUse = tagUse.empty() ? nullptr : tagUse.data();
+    return v;
+}
+
+// Finish the compiled form (16-bit narrowing, accelerable states)
+void packDFA(DFA &d) {
+    // a state is accelerable when the bytes that keep it in place form a few ranges
+    d.accelIndex.assign(d.numStates, -1);
+    d.accel.clear();
+    for (int s = 0; s < d.numStates; ++s) {
+        bool loop[256];
+        for (int b = 0; b < 256; ++b) loop[b] = d.next(s, (unsigned char)b) == s;
+        ByteRanges r;
+        if (makeByteRanges(loop, r)) {
+            d.accelIndex[s] = (int)d.accel.size();
+            d.accel.push_back(r);
         }
     }
-    // remap states to compact indices
-    std::map<int,int> remap;
-    int newId = 0;
-    for (int i = 0; i < (int)seen.size(); ++i) if (seen[i]) remap[i] = newId++;
-    DFA d2;
-    d2.start = remap[d.start];
-    d2.rev.resize(newId);
-    d2.trans.resize(newId);
-    for (auto &p : remap) {
-        d2.rev[p.second] = d.rev[p.first]; // copy NFA sets
-        if (d.accepts.count(p.first)) d2.accepts.insert(p.second);
-        // copy transitions
-        for (auto &kv : d.trans[p.first]) {
-            int to = kv.second;
-            if (!seen[to]) continue;
-            char c = kv.first;
-            d2.trans[p.second][c] = remap[to];
+
+    if (!d.table.empty() && d.numStates < DFA_DEAD16) {
+        d.table16.resize(d.table.size());
+        for (size_t i = 0; i < d.table.size(); ++i)
+            d.table16[i] = d.table[i] == DFA_DEAD ? DFA_DEAD16 : (uint16_t)d.table[i];
+        std::vector<int32_t>().swap(d.table);
+    }
+    d.sheng.clear();
+    if (shengPreferred(d.view())) buildShengTable(d.view(), d.sheng);
+    d.lookahead = dfaLookahead(d.view());
+}
+
+// Longest non-accepting walk, by iterative DFS (cycle: unbounded)
+int dfaLookahead(const DFAView &v) {
+    auto step = [&v](int s, int c) {
+        size_t i = (size_t)s * v.alphabet + c;
+        if (v.table16) return v.table16[i] == DFA_DEAD16 ? DFA_DEAD : (int)v.table16[i];
+        return (int)v.table[i];
+    };
+    // depth[s]: non-accepting states a walk from s can still enter; -1 unvisited, -2 on the DFS stack
+    std::vector<int> depth(v.numStates, -1);
+    std::vector<std::pair<int,int>> stack; // (state, next class to look at)
+    int best = 0;
+    for (int root = 0; root < v.numStates; ++root) {
+        if (depth[root] != -1) continue;
+        depth[root] = -2;
+        stack.push_back({root, 0});
+        while (!stack.empty()) {
+            int s = stack.back().first, &c = stack.back().second;
+            if (c < v.alphabet) {
+                int t = step(s, c++);
+                if (t == DFA_DEAD || v.isAccept(t)) continue;
+                if (depth[t] == -2) return -1;
+                if (depth[t] == -1) { depth[t] = -2; stack.push_back({t, 0}); }
+                continue;
+            }
+            int d = 0;
+            for (int k = 0; k < v.alphabet; ++k) {
+                int t = step(s, k);
+                if (t != DFA_DEAD && !v.isAccept(t)) d = std::max(d, depth[t] + 1);
+            }
+            depth[s] = d;
+            best = std::max(best, d);
+            stack.pop_back();
         }
     }
-    return d2;
+    return best + 1;
 }
 
 // DFA longest match
 int dfaLongestMatch(const DFA &d, const std::string &s, int pos) {
-    if (d.rev.empty()) return 0;
-    int cur = d.start;
-    if (cur < 0 || cur >= (int)d.rev.size()) return 0;
-    int lastAcceptPos = -1;
-    for (int i = pos; i < (int)s.size(); ++i) {
-        char c = s[i];
-        auto it = d.trans[cur].find(c);
-        if (it == d.trans[cur].end()) break;
-        cur = it->second;
-        if (d.accepts.count(cur)) lastAcceptPos = i;
-    }
-    return lastAcceptPos >= 0 ? (lastAcceptPos - pos + 1) : 0;
-}
-
-// Modified version of dfaLongestMatch that returns the path taken
-std::pair<int, QVector<int>> dfaLongestMatchWithTrace(const DFA &d, const std::string &s, int pos) {
-    if (d.rev.empty()) return {0, {}};
-    int cur = d.start;
-    if (cur < 0 || cur >= (int)d.rev.size()) return {0, {}};
-
-    int lastAcceptPos = -1;
-    QVector<int> path;
-    path.append(cur); // Start with the initial state
-
-    for (int i = pos; i < (int)s.size(); ++i) {
-        char c = s[i];
-        auto it = d.trans[cur].find(c);
-        if (it == d.trans[cur].end()) break;
-        cur = it->second;
-        path.append(cur); // Record the state we moved to
-        if (d.accepts.count(cur)) lastAcceptPos = i;
-    }
-
-    return {lastAcceptPos >= 0 ? (lastAcceptPos - pos + 1) : 0, path};
+    return dfaLongestMatchTagged(d, s, pos, nullptr);
+}
+
+// DFA longest match that also reports the accept tag of the match (-1 when none)
+int dfaLongestMatchTagged(const DFA &d, const std::string &s, int pos, int *tag) {
+    return dfaLongestMatchTagged(d.view(), s, pos, tag);
+}
+
+int dfaLongestMatchTagged(const DFAView &v, const std::string &s, int pos, int *tag) {
+    if (tag) *tag = -1;
+    if (v.numStates == 0) return 0;
+    if (v.start < 0 || v.start >= v.numStates) return 0;
+    int acceptState = -1;
+    NoSink none;
+    int len = matchLongest(v, s, pos, none, &acceptState);
+    if (tag && acceptState >= 0) *tag = v.acceptTag[acceptState];
+    return len;
+}
+
+// Longest match recording the position tags of the winning token
+int dfaLongestMatchCaptures(const DFAView &v, const std::string &s, int pos, int *tag, int *tagPos) {
+    if (tag) *tag = -1;
+    for (int t = 0; t < v.numTags; ++t) tagPos[t] = -1;
+    if (v.numStates == 0) return 0;
+    if (v.start < 0 || v.start >= v.numStates) return 0;
+    if (v.numTags == 0) return dfaLongestMatchTagged(v, s, pos, tag);
+    int acceptState = -1;
+    int len = v.table16
+        ? runTaggedLongestMatch(v, v.table16, DFA_DEAD16, s, pos, tagPos, &acceptState)
+        : runTaggedLongestMatch(v, v.table, (int32_t)DFA_DEAD, s, pos, tagPos, &acceptState);
+    if (tag && acceptState >= 0) *tag = v.acceptTag[acceptState];
+    return len;
+}
+
+// Lockstep longest match over many streams
+void dfaLongestMatchBatch(const DFAView &v, MatchStream *streams, int count) {
+    if (v.numStates == 0 || v.start < 0 || v.start >= v.numStates || (v.sheng && shengSupported())) {
+        // one stream after another; tagged DFAs still report their tags
+        for (int k = 0; k < count; ++k) {
+            MatchStream &m = streams[k];
+            m.len = v.numTags && m.tagPos ? dfaLongestMatchCaptures(v, *m.input, m.pos, &m.tag, m.tagPos)
+                                          : dfaLongestMatchTagged(v, *m.input, m.pos, &m.tag);
+        }
+        return;
+    }
+    matchStreams(v, streams, count, [](int, MatchStream &) { return false; });
+}
+
+// Longest match that also records the path taken (start state first) into path
+int dfaLongestMatchWithTrace(const DFA &d, const std::string &s, int pos, std::vector<int> &path) {
+    path.clear();
+    if (d.numStates == 0) return 0;
+    if (d.start < 0 || d.start >= d.numStates) return 0;
+
+    // grown as states are entered, not sized to the rest of the input; the
+    // buffer keeps its capacity, so tracing again rarely allocates
+    path.push_back(d.start);
+    PathSink record(path);
+    int acceptState = -1;
+    return matchLongest(d.view(), s, pos, record, &acceptState);
 }
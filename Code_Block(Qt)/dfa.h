@@ -2,33 +2,239 @@
 #define DFA_H
 
 #include "nfa.h"
-#include <set>
+#include "accel.h"
+#include "sheng.h"
+#include "provenance.h"
 #include <map>
 #include <vector>
-#include <QVector> // For the trace path
+#include <cstdint>
+#include <array>
 
-// DFA representation
+// Dead-state sentinels stored in the transition table ("no transition")
+const int DFA_DEAD = -1;
+const uint16_t DFA_DEAD16 = 0xFFFF;
+
+// Sorted, duplicate-free list of NFA state ids (one DFA state during determinization)
+typedef std::vector<int> NFASet;
+
+// Instrumentation filled in by the construction stages
+struct DFABuildStats {
+    int nfaStates = 0;      // states of the source NFA
+    int statesBefore = 0;   // states out of subsetConstruction
+    int statesAfter = 0;    // states after minimization (== statesBefore when skipped)
+    int statesReused = 0;   // rows copied from the previous DFA (subsetConstructionIncremental)
+    double subsetMs = 0;    // wall time of subsetConstruction
+    double minimizeMs = 0;  // wall time of minimizeDFA
+};
+
+// Read-only view of compiled DFA tables. The matchers run on this, so tables
+// owned by a DFA and tables mapped from a file (dfaio.h) share one code path.
+struct DFAView {
+    int numStates = 0;
+    int alphabet = 1;
+    int start = 0;
+    const uint8_t *classOf = nullptr;
+    const uint16_t *table16 = nullptr;     // set when the table is narrow
+    const int32_t *table = nullptr;        // set when the table is wide
+    const uint64_t *acceptBits = nullptr;
+    const int *acceptTag = nullptr;
+    const int *accelIndex = nullptr;
+    const ByteRanges *accel = nullptr;
+    int numAccel = 0;                      // entries of accel
+    const uint8_t *sheng = nullptr;        // shuffle-engine table when that engine was picked (sheng.h)
+    int lookahead = 0;                     // see dfaLookahead
+    int numTags = 0;                       // position tags (tagdfa.h), 0 when untagged
+    const uint32_t *tagSet = nullptr;
+    const uint32_t *tagUse = nullptr;
+
+    bool isAccept(int s) const { return (acceptBits[s >> 6] >> (s & 63)) & 1; }
+};
+
+// DFA representation (compiled form: bytes map to equivalence classes through
+// classOf, and each state owns one flat row of `alphabet` class cells)
 struct DFA {
-    std::map<std::set<int>, int> mapping;
-    std::vector<std::set<int>> rev;            // reverse mapping: id -> NFA set
-    std::vector<std::map<char,int>> trans;     // per-state labeled transitions
-    std::set<int> accepts;
+    std::vector<NFASet> rev;                   // reverse mapping: id -> NFA set
+    std::vector<std::vector<int>> origin;      // minimized id -> merged pre-minimization ids
+    std::vector<NFASet> originRev;             // pre-minimization id -> NFA set
+    NFASetArena packedRev, packedOrigin, packedOriginRev;  // the three above once packed (provenance.h)
+    DFABuildStats stats;
+    int numStates = 0;
+    std::array<uint8_t, 256> classOf{};        // byte -> equivalence class
+    int alphabet = 1;                          // number of classes (cells per row)
+    std::vector<int32_t> table;                // wide table, used when states don't fit 16 bits
+    std::vector<uint16_t> table16;             // narrow table, used when numStates < DFA_DEAD16
+    std::vector<uint64_t> acceptBits;          // bit i set when state i accepts
+    std::vector<int> acceptTag;                // state -> winning NFA accept tag, -1 if not accepting
+    std::vector<int> accelIndex;               // state -> index into accel, -1 if not accelerable
+    std::vector<ByteRanges> accel;             // self-loop byte ranges of accelerable states
+    std::vector<uint8_t> sheng;                // shuffle-engine table, empty unless shengPreferred()
     int start = 0;
+    int hotStates = 0;                         // profile layout: states [0, hotStates) are hot (profile.h), 0 if none
+    int lookahead = 0;                         // dfaLookahead, set by packDFA
+    int numTags = 0;                           // position tags (tagdfa.h), 0 and empty masks when untagged
+    std::vector<uint32_t> tagSet;              // state -> tags set to the current position on entering it
+    std::vector<uint32_t> tagUse;              // state -> tags an accept there reports (those of the winning token)
+
+    // Next state on byte class cls, or DFA_DEAD
+    int step(int s, int cls) const {
+        size_t i = (size_t)s * alphabet + cls;
+        if (!table16.empty()) return table16[i] == DFA_DEAD16 ? DFA_DEAD : table16[i];
+        return table[i];
+    }
+    // Next state on byte c, or DFA_DEAD
+    int next(int s, unsigned char c) const { return step(s, classOf[c]); }
+    bool isAccept(int s) const { return (acceptBits[s >> 6] >> (s & 63)) & 1; }
+    DFAView view() const;
+};
+
+// Partition the 256 bytes into classes no NFA transition tells apart.
+// Classes are numbered by their smallest byte; returns the class count.
+int computeByteClasses(const NFA &n, std::array<uint8_t, 256> &classOf);
+
+// Labeled NFA edge over an inclusive byte interval
+struct NFARange { uint8_t lo, hi; int to; };
+
+// Counted loop of a FlatNFA: counts are bit vectors, bit k-1 set when the
+// loop may have taken k bytes (counting.h)
+struct FlatCounter {
+    int state, exit;
+    uint64_t mask;          // bits of the counts the loop can hold
+    uint64_t exitMask;      // counts that may leave for exit
+    bool saturate;          // no upper bound: the top count absorbs larger ones
+};
+
+// NFA flattened for determinization: epsilon edges and labeled byte intervals in CSR form
+struct FlatNFA {
+    int numStates = 0;
+    int start = -1;
+    std::array<uint8_t, 256> classOf{};
+    int alphabet = 1;
+    std::vector<int> classRep;               // class -> smallest byte in it
+    std::vector<int> epsStart, epsTo;        // eps edges of s: epsTo[epsStart[s] .. epsStart[s+1])
+    std::vector<int> rangeStart;             // labeled edges of s: ranges[rangeStart[s] .. rangeStart[s+1])
+    std::vector<NFARange> ranges;            // maximal byte intervals per (state, target)
+    std::vector<int> classesByRep;           // class ids ordered by representative byte
+    std::vector<int> acceptTag;              // NFA state -> accept tag, -1 if not accepting
+    std::vector<int> tagOf;                  // NFA state -> position tag, -1 if none
+    int numTags = 0;
+    std::vector<int> counterOf;              // NFA state -> index into counters, -1 if not a counted loop
+    std::vector<FlatCounter> counters;       // empty unless flattened with keepCounters
+};
+
+// A counting NFA (repeatFrag) is flattened with its counted loops expanded
+// (expandCounters), so every determinizing stage sees a plain NFA; the
+// matchers that simulate counters (lazydfa.h, nfasim.h) set keepCounters.
+FlatNFA flattenNFA(const NFA &n, bool keepCounters = false);
+
+// Reusable buffers for set operations, so the worklist loop does not allocate
+struct SubsetScratch {
+    std::vector<uint32_t> mark;  // mark[s] == gen when s is already in the set being built
+    uint32_t gen = 0;
+    std::vector<int> stack;
+    std::vector<std::pair<int,int>> events; // interval sweep: (byte, +/-(target+1))
+    std::vector<int> active;                // targets with a live interval at the sweep point
+    std::vector<int> live;                  // per NFA state: number of intervals covering the sweep point
+    NFASet moved, lastTargets;
+    uint32_t nextGen(int numStates);
+};
+
+// Outgoing transitions of one DFA state: class cls[j] goes to the closed,
+// sorted set targets[target[j]]. Consecutive label intervals with the same
+// targets share one entry; buffers are reused from state to state.
+struct SubsetRow {
+    int count = 0;                 // distinct target sets in targets[0 .. count)
+    std::vector<NFASet> targets;
+    std::vector<int> cls, target;
 };
 
-// Epsilon closure
-std::set<int> epsClosure(const NFA &n, const std::set<int> &states);
+// In-place epsilon closure of a set; the result is sorted
+void epsClosureInto(const FlatNFA &n, NFASet &set, SubsetScratch &scratch);
+
+// Targets of the set on byte class c (not closed, sorted)
+void moveOnClassInto(const FlatNFA &n, const NFASet &set, int c, NFASet &out, SubsetScratch &scratch);
+
+// Winning accept tag of a set (the lowest one), -1 if no member accepts
+int subsetAcceptTag(const FlatNFA &n, const NFASet &set);
 
-// Move on char
-std::set<int> moveOnChar(const NFA &n, const std::set<int> &states, char c);
+// Transitions of one DFA state, sweeping the disjoint intervals of the
+// outgoing labels once each instead of moving on every class
+void expandSubsetState(const FlatNFA &n, const NFASet &set, SubsetScratch &scratch, SubsetRow &row);
+
+// 64-bit fingerprint of an NFA set
+uint64_t hashNFASet(const NFASet &s);
+
+// Open-addressing table interning NFA sets to dense ids (fingerprint first, full compare on hit)
+class NFASetTable {
+public:
+    int intern(const NFASet &s, bool *added = nullptr);
+    int find(const NFASet &s) const;             // id of s, -1 if not interned
+    int size() const { return (int)m_sets.size(); }
+    const NFASet &at(int id) const { return m_sets[id]; }
+    std::vector<NFASet> release();
+    void clear();
+
+private:
+    std::vector<NFASet> m_sets;
+    std::vector<uint64_t> m_hash;
+    std::vector<int> m_slots; // DFA id or -1
+    void rehash(size_t slots);
+};
 
-// Subset construction (NFA -> DFA) with reachable pruning
+// Subset construction (NFA -> DFA). Every state is discovered through a
+// transition from the start, so the result has no unreachable states.
 DFA subsetConstruction(const NFA &n);
 
+// Finish the compiled form: narrow the table to 16 bits when the state count
+// allows it, find accelerable states (self-loop on a few byte ranges), build
+// the shuffle-engine table when shengPreferred() picks that engine and
+// compute the lookahead bound
+void packDFA(DFA &d);
+
+// Most bytes a longest match can read past its last accept (or past its
+// start when nothing accepts): the longest walk through non-accepting states
+// plus the byte that ends it. -1 when non-accepting states form a cycle; then
+// restarting after every token can rescan the same bytes without bound and
+// the tokenizer switches to memoized maximal munch (matcher.h).
+int dfaLookahead(const DFAView &v);
+
 // DFA longest match
 int dfaLongestMatch(const DFA &d, const std::string &s, int pos);
 
-// Modified version of dfaLongestMatch that returns the path taken
-std::pair<int, QVector<int>> dfaLongestMatchWithTrace(const DFA &d, const std::string &s, int pos);
+// DFA longest match that also reports the accept tag of the match (-1 when none).
+// DFAs with a shuffle table run on that engine when the CPU has it, others on the table.
+int dfaLongestMatchTagged(const DFA &d, const std::string &s, int pos, int *tag);
+int dfaLongestMatchTagged(const DFAView &v, const std::string &s, int pos, int *tag);
+
+// Longest match on a tagged DFA that also reports where the position tags
+// of the winning token fell: tagPos[t] (v.numTags entries) is the offset in s
+// of tag t, -1 when the match did not pass it or the token has no such tag.
+// Tags are recorded during the one scan; untagged DFAs report only -1.
+int dfaLongestMatchCaptures(const DFAView &v, const std::string &s, int pos, int *tag, int *tagPos);
+
+// One input of a batch match: input and start position in, length and tag out.
+// On a tagged DFA, tagPos (numTags entries, when set) gets the tag positions
+// as dfaLongestMatchCaptures reports them.
+struct MatchStream {
+    const std::string *input = nullptr;
+    int pos = 0;
+    int len = 0;
+    int tag = -1;
+    int *tagPos = nullptr;
+};
+
+// Streams advanced together by one batch call; larger batches are split
+const int MATCH_BATCH_MAX = 16;
+
+// dfaLongestMatchTagged for many independent streams at once. Streams step
+// through v in lockstep, so their table loads overlap instead of each
+// transition waiting on the previous one; best with 4 to 16 streams.
+// DFAs on the shuffle engine are matched one stream after another.
+void dfaLongestMatchBatch(const DFAView &v, MatchStream *streams, int count);
+
+// DFA longest match that also records the states visited, start state first,
+// into path (left empty when d has no states). path is a reusable buffer:
+// it grows with the match only, so a caller that keeps it avoids reallocating.
+// The generic matcher with other sinks is in matcher.h.
+int dfaLongestMatchWithTrace(const DFA &d, const std::string &s, int pos, std::vector<int> &path);
 
 #endif // DFA_H
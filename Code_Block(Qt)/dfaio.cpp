@@ -0,0 +1,406 @@
+#include "dfaio.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char DFA_FILE_MAGIC[8] = { 'C','B','D','F','A','\r','\n','\x1a' };
+static const uint32_t DFA_BYTE_ORDER = 0x01020304;
+
+// accel ranges are mapped in place, so their layout is part of the format
+static_assert(sizeof(ByteRanges) == 12 && offsetof(ByteRanges, lo) == 4 && offsetof(ByteRanges, hi) == 8,
+              "ByteRanges layout is part of the DFA file format");
+static_assert(sizeof(int) == 4, "accept tags and accel indices are stored as int32");
+static_assert(sizeof(DFAFileHeader) == 152, "DFAFileHeader must not contain padding");
+
+static void setError(std::string *error, const char *msg) {
+    if (error) *error = msg;
+}
+
+static uint64_t fnv1a(const unsigned char *p, size_t n, uint64_t h = 1469598103934665603ull) {
+    for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 1099511628211ull; }
+    return h;
+}
+
+static void hashInt(uint64_t &h, int64_t v) {
+    h = fnv1a((const unsigned char *)&v, sizeof(v), h);
+}
+
+// Fingerprint of a token spec (states, labels, eps edges, accepts, tags and counters)
+uint64_t hashNFASpec(const NFA &n) {
+    uint64_t h = 1469598103934665603ull;
+    hashInt(h, (int64_t)n.states.size());
+    hashInt(h, n.start);
+    for (const NFAState &s : n.states) {
+        hashInt(h, (int64_t)s.trans.size());
+        for (const auto &kv : s.trans) {
+            hashInt(h, (unsigned char)kv.first);
+            for (int t : kv.second) hashInt(h, t);
+        }
+        hashInt(h, -(int64_t)s.eps.size());
+        for (int t : s.eps) hashInt(h, t);
+    }
+    for (int a : n.accepts) {
+        auto t = n.acceptTag.find(a);
+        hashInt(h, a);
+        hashInt(h, t == n.acceptTag.end() ? 0 : t->second);
+    }
+    for (const auto &kv : n.tagOf) {
+        hashInt(h, -(int64_t)kv.first - 1);
+        hashInt(h, kv.second);
+    }
+    for (const auto &kv : n.counterOf) {
+        hashInt(h, kv.first);
+        hashInt(h, kv.second.min);
+        hashInt(h, kv.second.max);
+        hashInt(h, kv.second.exit);
+    }
+    return h;
+}
+
+// Append bytes at the next 8-byte boundary; returns their offset
+static uint64_t appendSection(std::vector<unsigned char> &img, const void *data, size_t n) {
+    img.resize((img.size() + 7) & ~size_t(7), 0);
+    uint64_t off = img.size();
+    const unsigned char *p = (const unsigned char *)data;
+    img.insert(img.end(), p, p + n);
+    return off;
+}
+
+// Write img to a new file next to path under a name no other writer picks
+// (two instances may save the same cache at once); its name goes to tmp
+static bool writeTempFile(const std::string &path, const std::vector<unsigned char> &img,
+                          std::string &tmp, std::string *error) {
+#ifdef _WIN32
+    static std::atomic<unsigned> serial{0};
+    tmp = path + ".tmp" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(serial++);
+    HANDLE file = CreateFileA(tmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) { setError(error, "cannot open file for writing"); return false; }
+    bool ok = true;
+    for (size_t done = 0; ok && done < img.size();) {
+        DWORD chunk = (DWORD)std::min<size_t>(img.size() - done, 1u << 30), wrote = 0;
+        ok = WriteFile(file, img.data() + done, chunk, &wrote, nullptr) && wrote == chunk;
+        done += wrote;
+    }
+    CloseHandle(file);
+#else
+    std::vector<char> name(path.begin(), path.end());
+    const char suffix[] = ".tmpXXXXXX";
+    name.insert(name.end(), suffix, suffix + sizeof(suffix));
+    int fd = mkstemp(name.data());
+    if (fd < 0) { setError(error, "cannot open file for writing"); return false; }
+    tmp = name.data();
+    bool ok = fchmod(fd, 0644) == 0;
+    for (size_t done = 0; ok && done < img.size();) {
+        ssize_t wrote = write(fd, img.data() + done, img.size() - done);
+        ok = wrote > 0;
+        if (ok) done += (size_t)wrote;
+    }
+    ok = close(fd) == 0 && ok;
+#endif
+    if (!ok) { std::remove(tmp.c_str()); setError(error, "write failed"); }
+    return ok;
+}
+
+bool saveDFA(const DFA &d, const std::string &path, uint64_t specHash,
+             bool withProvenance, std::string *error) {
+    std::vector<unsigned char> img(sizeof(DFAFileHeader), 0);
+    DFAFileHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, DFA_FILE_MAGIC, sizeof(h.magic));
+    h.version = DFA_FILE_VERSION;
+    h.byteOrder = DFA_BYTE_ORDER;
+    h.specHash = specHash;
+    h.numStates = d.numStates;
+    h.alphabet = d.alphabet;
+    h.start = d.start;
+    h.cellBytes = d.table16.empty() ? 4 : 2;
+    h.numAccel = (int32_t)d.accel.size();
+    h.hotStates = d.hotStates;
+
+    h.classOfOff = appendSection(img, d.classOf.data(), d.classOf.size());
+    h.tableOff = d.table16.empty()
+        ? appendSection(img, d.table.data(), d.table.size() * sizeof(int32_t))
+        : appendSection(img, d.table16.data(), d.table16.size() * sizeof(uint16_t));
+    h.acceptBitsOff = appendSection(img, d.acceptBits.data(), d.acceptBits.size() * sizeof(uint64_t));
+    h.acceptTagOff = appendSection(img, d.acceptTag.data(), d.acceptTag.size() * sizeof(int));
+    h.accelIndexOff = appendSection(img, d.accelIndex.data(), d.accelIndex.size() * sizeof(int));
+    h.accelOff = appendSection(img, d.accel.data(), d.accel.size() * sizeof(ByteRanges));
+    NFASetArena packed;
+    const NFASetArena *prov = nullptr;
+    if (withProvenance && (int)d.rev.size() == d.numStates) {
+        packed.assign(d.rev);
+        prov = &packed;
+    } else if (withProvenance && d.packedRev.size() == d.numStates) {
+        prov = &d.packedRev;
+    }
+    if (prov) {
+        h.provOff = appendSection(img, prov->offsets.data(), prov->offsets.size() * sizeof(uint32_t));
+        appendSection(img, prov->bytes.data(), prov->bytes.size());
+        h.provSize = img.size() - h.provOff;
+    }
+    if (d.numTags > 0) {
+        h.numTags = d.numTags;
+        h.tagSetOff = appendSection(img, d.tagSet.data(), d.tagSet.size() * sizeof(uint32_t));
+        h.tagUseOff = appendSection(img, d.tagUse.data(), d.tagUse.size() * sizeof(uint32_t));
+    }
+    h.fileSize = img.size();
+    h.checksum = fnv1a(img.data() + sizeof(h), img.size() - sizeof(h));
+    std::memcpy(img.data(), &h, sizeof(h));
+
+    // write a temporary file first so readers never see a half-written table,
+    // then replace path in one step so it is never missing either
+    std::string tmp;
+    if (!writeTempFile(path, img, tmp, error)) return false;
+#ifdef _WIN32
+    bool replaced = MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool replaced = std::rename(tmp.c_str(), path.c_str()) == 0;
+#endif
+    if (!replaced) {
+        std::remove(tmp.c_str());
+        setError(error, "cannot replace DFA file");
+        return false;
+    }
+    return true;
+}
+
+static bool sectionFits(const DFAFileHeader &h, uint64_t off, uint64_t bytes) {
+    return off % 8 == 0 && off >= sizeof(DFAFileHeader) && off <= h.fileSize && bytes <= h.fileSize - off;
+}
+
+// Check header, checksum and section bounds of a file image, then point v into it
+static bool validateImage(const unsigned char *data, size_t size, uint64_t specHash,
+                          DFAView &v, std::string *error) {
+    if (size < sizeof(DFAFileHeader)) { setError(error, "file too small"); return false; }
+    DFAFileHeader h;
+    std::memcpy(&h, data, sizeof(h));
+    if (std::memcmp(h.magic, DFA_FILE_MAGIC, sizeof(h.magic)) != 0) { setError(error, "not a DFA file"); return false; }
+    if (h.version != DFA_FILE_VERSION) { setError(error, "unsupported DFA file version"); return false; }
+    if (h.byteOrder != DFA_BYTE_ORDER) { setError(error, "DFA file has foreign byte order"); return false; }
+    if (h.specHash != specHash) { setError(error, "DFA file was built from a different token spec"); return false; }
+    if (h.fileSize != size) { setError(error, "DFA file is truncated"); return false; }
+    if (fnv1a(data + sizeof(h), size - sizeof(h)) != h.checksum) { setError(error, "DFA file checksum mismatch"); return false; }
+    if (h.numStates <= 0 || h.alphabet <= 0 || h.alphabet > 256 || h.start < 0 || h.start >= h.numStates
+        || (h.cellBytes != 2 && h.cellBytes != 4) || h.numAccel < 0
+        || h.hotStates < 0 || h.hotStates > h.numStates || h.numTags < 0 || h.numTags > MAX_TAGS) {
+        setError(error, "DFA file header is inconsistent"); return false;
+    }
+    uint64_t cells = (uint64_t)h.numStates * h.alphabet;
+    uint64_t n = (uint64_t)h.numStates;
+    if (!sectionFits(h, h.classOfOff, 256) || !sectionFits(h, h.tableOff, cells * h.cellBytes)
+        || !sectionFits(h, h.acceptBitsOff, (n + 63) / 64 * 8) || !sectionFits(h, h.acceptTagOff, n * 4)
+        || !sectionFits(h, h.accelIndexOff, n * 4) || !sectionFits(h, h.accelOff, (uint64_t)h.numAccel * sizeof(ByteRanges))
+        || (h.provOff && !sectionFits(h, h.provOff, h.provSize))
+        || (h.numTags && (!sectionFits(h, h.tagSetOff, n * 4) || !sectionFits(h, h.tagUseOff, n * 4)))) {
+        setError(error, "DFA file section out of bounds"); return false;
+    }
+
+    v = DFAView();
+    v.numStates = h.numStates;
+    v.alphabet = h.alphabet;
+    v.start = h.start;
+    v.classOf = data + h.classOfOff;
+    if (h.cellBytes == 2) v.table16 = (const uint16_t *)(data + h.tableOff);
+    else v.table = (const int32_t *)(data + h.tableOff);
+    v.acceptBits = (const uint64_t *)(data + h.acceptBitsOff);
+    v.acceptTag = (const int *)(data + h.acceptTagOff);
+    v.accelIndex = (const int *)(data + h.accelIndexOff);
+    v.accel = (const ByteRanges *)(data + h.accelOff);
+    v.numAccel = h.numAccel;
+    if (h.numTags) {
+        v.numTags = h.numTags;
+        v.tagSet = (const uint32_t *)(data + h.tagSetOff);
+        v.tagUse = (const uint32_t *)(data + h.tagUseOff);
+    }
+
+    // matchers index with these without checks, so reject out-of-range
+    // classes and cells
+    for (int b = 0; b < 256; ++b) {
+        if (v.classOf[b] >= h.alphabet) { setError(error, "DFA file has a bad byte class"); return false; }
+    }
+    for (uint64_t i = 0; i < cells; ++i) {
+        int t = v.table16 ? (v.table16[i] == DFA_DEAD16 ? DFA_DEAD : v.table16[i]) : v.table[i];
+        if (t != DFA_DEAD && (t < 0 || t >= h.numStates)) { setError(error, "DFA file has a bad transition"); return false; }
+    }
+    for (int s = 0; s < h.numStates; ++s) {
+        if (v.accelIndex[s] < -1 || v.accelIndex[s] >= h.numAccel) { setError(error, "DFA file has a bad accel index"); return false; }
+        // matchers test the bit and report the tag, so the two must agree
+        if (v.isAccept(s) != (v.acceptTag[s] >= 0)) { setError(error, "DFA file has inconsistent accept states"); return false; }
+    }
+    // the scan kernels copy count ranges into fixed arrays, so a bad count
+    // would write past them
+    for (int a = 0; a < h.numAccel; ++a) {
+        const ByteRanges &r = v.accel[a];
+        bool ok = r.count >= 0 && r.count <= ACCEL_MAX_RANGES;
+        for (int k = 0; ok && k < r.count; ++k) ok = r.lo[k] <= r.hi[k];
+        if (!ok) { setError(error, "DFA file has bad accel ranges"); return false; }
+    }
+    // the tagged matcher keeps one register per tag, indexed by these bits
+    uint32_t tagMask = h.numTags == MAX_TAGS ? ~0u : (1u << h.numTags) - 1;
+    for (int s = 0; s < h.numStates && h.numTags; ++s) {
+        if ((v.tagSet[s] | v.tagUse[s]) & ~tagMask) { setError(error, "DFA file has a bad tag mask"); return false; }
+    }
+    return true;
+}
+
+// runLongestMatch skips a whole run once it sees a byte inside the state's
+// ranges, so each of those bytes must lead back to the state itself
+static bool accelRangesLoop(const DFAView &v) {
+    for (int s = 0; s < v.numStates; ++s) {
+        if (v.accelIndex[s] < 0) continue;
+        const ByteRanges &r = v.accel[v.accelIndex[s]];
+        const size_t row = (size_t)s * v.alphabet;
+        for (int k = 0; k < r.count; ++k) {
+            for (int b = r.lo[k]; b <= r.hi[k]; ++b) {
+                size_t i = row + v.classOf[b];
+                int t = v.table16 ? (v.table16[i] == DFA_DEAD16 ? DFA_DEAD : v.table16[i]) : v.table[i];
+                if (t != s) return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Locate the provenance section: its offsets and arena bytes, false if the
+// file has none or it does not fit
+static bool provenanceSection(const unsigned char *data, int numStates,
+                              const uint32_t *&offsets, const uint8_t *&bytes) {
+    DFAFileHeader h;
+    std::memcpy(&h, data, sizeof(h));
+    if (!h.provOff || h.provSize < (uint64_t)(numStates + 1) * 4) return false;
+    offsets = (const uint32_t *)(data + h.provOff);
+    uint64_t bytesOff = (h.provOff + (uint64_t)(numStates + 1) * 4 + 7) & ~uint64_t(7);
+    bytes = data + bytesOff;
+    return bytesOff + offsets[numStates] <= h.provOff + h.provSize;
+}
+
+// Decode one set of the provenance section
+static bool readProvenance(const unsigned char *data, int numStates, int state, NFASet &out) {
+    const uint32_t *offsets;
+    const uint8_t *bytes;
+    if (state < 0 || state >= numStates || !provenanceSection(data, numStates, offsets, bytes)) return false;
+    if (offsets[state] > offsets[state + 1] || offsets[state + 1] > offsets[numStates]) return false;
+    return decodeNFASet(bytes + offsets[state], bytes + offsets[state + 1], out);
+}
+
+bool loadDFA(const std::string &path, uint64_t specHash, DFA &out, std::string *error) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) { setError(error, "cannot open DFA file"); return false; }
+    std::vector<unsigned char> img((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    DFAView v;
+    if (!validateImage(img.data(), img.size(), specHash, v, error)) return false;
+
+    DFA d;
+    d.numStates = v.numStates;
+    d.alphabet = v.alphabet;
+    d.start = v.start;
+    DFAFileHeader h;
+    std::memcpy(&h, img.data(), sizeof(h));
+    d.hotStates = h.hotStates;
+    std::memcpy(d.classOf.data(), v.classOf, 256);
+    size_t cells = (size_t)v.numStates * v.alphabet;
+    if (v.table16) d.table16.assign(v.table16, v.table16 + cells);
+    else d.table.assign(v.table, v.table + cells);
+    d.acceptBits.assign(v.acceptBits, v.acceptBits + (v.numStates + 63) / 64);
+    d.acceptTag.assign(v.acceptTag, v.acceptTag + v.numStates);
+    if (v.numTags) {
+        d.numTags = v.numTags;
+        d.tagSet.assign(v.tagSet, v.tagSet + v.numStates);
+        d.tagUse.assign(v.tagUse, v.tagUse + v.numStates);
+    }
+    // provenance stays packed: the arena is copied as is and NFASetArena::get
+    // bounds-checks each set when the visualizer decodes it
+    const uint32_t *offsets;
+    const uint8_t *bytes;
+    if (provenanceSection(img.data(), v.numStates, offsets, bytes)) {
+        d.packedRev.offsets.assign(offsets, offsets + v.numStates + 1);
+        d.packedRev.bytes.assign(bytes, bytes + offsets[v.numStates]);
+    }
+    d.stats.statesBefore = d.stats.statesAfter = d.numStates;
+    // accel ranges, shuffle table and lookahead are derived from the table
+    // rather than trusted from the file
+    packDFA(d);
+    out = std::move(d);
+    return true;
+}
+
+MappedDFA::~MappedDFA() {
+    close();
+}
+
+bool MappedDFA::open(const std::string &path, uint64_t specHash, std::string *error) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) { setError(error, "cannot open DFA file"); return false; }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) { CloseHandle(file); setError(error, "cannot size DFA file"); return false; }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) { CloseHandle(file); setError(error, "cannot map DFA file"); return false; }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) { CloseHandle(mapping); CloseHandle(file); setError(error, "cannot map DFA file"); return false; }
+    m_file = file;
+    m_mapping = mapping;
+    m_data = (const unsigned char *)data;
+    m_size = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { setError(error, "cannot open DFA file"); return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); setError(error, "cannot size DFA file"); return false; }
+    void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (data == MAP_FAILED) { setError(error, "cannot map DFA file"); return false; }
+    m_data = (const unsigned char *)data;
+    m_size = (size_t)st.st_size;
+#endif
+    if (!validateImage(m_data, m_size, specHash, m_view, error)) {
+        close();
+        return false;
+    }
+    // the accel ranges stay mapped, so check them against the table
+    // instead of rebuilding them as loadDFA does
+    if (!accelRangesLoop(m_view)) {
+        close();
+        setError(error, "DFA file has accel ranges that leave their state");
+        return false;
+    }
+    // the shuffle table is derived data: rebuilt here for small DFAs, never stored
+    if (shengPreferred(m_view)) buildShengTable(m_view, m_sheng);
+    m_view.sheng = m_sheng.empty() ? nullptr : m_sheng.data();
+    m_view.lookahead = dfaLookahead(m_view);
+    return true;
+}
+
+void MappedDFA::close() {
+    if (!m_data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle((HANDLE)m_mapping);
+    CloseHandle((HANDLE)m_file);
+    m_file = m_mapping = nullptr;
+#else
+    munmap((void *)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_view = DFAView();
+    m_sheng.clear();
+}
+
+bool MappedDFA::provenance(int state, NFASet &out) const {
+    return m_data && readProvenance(m_data, m_view.numStates, state, out);
+}
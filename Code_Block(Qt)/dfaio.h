@@ -0,0 +1,79 @@
+#ifndef DFAIO_H
+#define DFAIO_H
+
+#include "dfa.h"
+#include <string>
+
+// Compiled DFA file format (little-endian, position independent):
+//   DFAFileHeader
+//   sections at 8-byte aligned offsets from the start of the file:
+//   class map (256 bytes), transition table (2- or 4-byte cells), accept
+//   bitmap, accept tags, accelerable-state index and ranges, an optional
+//   provenance section (numStates+1 offsets, then the NFA sets as one
+//   NFASetArena byte run: varint first id and gaps, see provenance.h)
+//   and, for a tagged DFA (tagdfa.h), the tagSet and tagUse masks per state.
+// Rows are stored in the DFA's own state order; after applyProfileLayout
+// (profile.h) that is hot-first and hotStates counts the hot rows.
+// checksum covers every byte after the header. specHash is supplied by the
+// caller (see hashNFASpec) so a file built from an older token spec is rejected.
+const uint32_t DFA_FILE_VERSION = 4;
+
+struct DFAFileHeader {
+    char magic[8];            // "CBDFA\r\n\x1a"
+    uint32_t version;         // DFA_FILE_VERSION
+    uint32_t byteOrder;       // 0x01020304 as written by the producer
+    uint64_t specHash;
+    uint64_t checksum;        // FNV-1a over bytes [sizeof(DFAFileHeader), fileSize)
+    uint64_t fileSize;
+    int32_t numStates, alphabet, start, cellBytes;
+    int32_t numAccel, hotStates;   // hotStates: 0 when the layout was not profiled
+    uint64_t classOfOff, tableOff, acceptBitsOff, acceptTagOff;
+    uint64_t accelIndexOff, accelOff, provOff, provSize;
+    int32_t numTags, reserved;     // numTags: 0 and no tag sections when untagged
+    uint64_t tagSetOff, tagUseOff;
+};
+
+// Fingerprint of a token spec (states, labels, eps edges, accepts, tags and counters)
+uint64_t hashNFASpec(const NFA &n);
+
+// Write d to path; provenance (DFA::rev, or packedRev once packed) is included
+// when withProvenance is set
+bool saveDFA(const DFA &d, const std::string &path, uint64_t specHash,
+             bool withProvenance, std::string *error = nullptr);
+
+// Read path into an owned DFA. Provenance, when the file has it, is kept
+// packed in packedRev and decoded only when a state's set is asked for.
+// Accel ranges are rebuilt from the table (packDFA), not read from the file.
+bool loadDFA(const std::string &path, uint64_t specHash, DFA &out, std::string *error = nullptr);
+
+// Read-only, shared mapping of a compiled DFA file. view() points straight
+// into the mapping, so many processes can match against one copy.
+// Accel ranges are used in place once every byte in them is checked to
+// loop back to its state.
+class MappedDFA {
+public:
+    MappedDFA() = default;
+    ~MappedDFA();
+    MappedDFA(const MappedDFA &) = delete;
+    MappedDFA &operator=(const MappedDFA &) = delete;
+
+    bool open(const std::string &path, uint64_t specHash, std::string *error = nullptr);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+    const DFAView &view() const { return m_view; }
+
+    // NFA set of a state from the provenance section; false if the file has none
+    bool provenance(int state, NFASet &out) const;
+
+private:
+    const unsigned char *m_data = nullptr;
+    size_t m_size = 0;
+    DFAView m_view;
+    std::vector<uint8_t> m_sheng;
+#ifdef _WIN32
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
+
+#endif // DFAIO_H
@@ -0,0 +1,22 @@
+#ifndef DIRECT_SCANNER_H
+#define DIRECT_SCANNER_H
+
+#include <cstdint>
+#include <string>
+
+// Direct-coded lexer generated by scangen at build time (lexer_scanner.cpp in
+// the build directory). Only CODEBLOCK_DIRECT_SCANNER builds link it.
+
+// Longest match of the combined lexer at pos; *tag gets the winning TokenKind
+// (-1 when none) and tagPos, unless null, the Number captures' tag positions
+// (directScannerNumTags entries, as dfaLongestMatchCaptures reports them)
+int directLongestMatch(const std::string &s, int pos, int *tag, int *tagPos);
+
+// hashNFASpec of the token spec the scanner was generated from; a scanner
+// whose hash differs from the running spec's is stale and must not be used
+extern const uint64_t directScannerSpecHash;
+
+// Position tags of the lexer the scanner was generated from
+extern const int directScannerNumTags;
+
+#endif // DIRECT_SCANNER_H
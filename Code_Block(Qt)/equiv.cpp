@@ -0,0 +1,105 @@
+#include "equiv.h"
+#include <unordered_map>
+
+// A DFA with the dead state made explicit as state numStates, so every pair
+// of states has a successor pair on every byte
+struct EquivSide {
+    const DFAView *v;
+    int dead;
+
+    explicit EquivSide(const DFAView &view) : v(&view), dead(view.numStates) {}
+    int start() const { return v->start >= 0 && v->start < v->numStates ? v->start : dead; }
+    int tag(int s) const { return s == dead ? -1 : v->acceptTag[s]; }
+    int step(int s, int cls) const {
+        if (s == dead) return dead;
+        size_t i = (size_t)s * v->alphabet + cls;
+        int t = v->table16 ? (v->table16[i] == DFA_DEAD16 ? DFA_DEAD : v->table16[i]) : v->table[i];
+        return t == DFA_DEAD ? dead : t;
+    }
+};
+
+// Union-find with path halving and union by size
+struct StateUnion {
+    std::vector<int> parent, size;
+
+    explicit StateUnion(int n) : parent(n), size(n, 1) {
+        for (int i = 0; i < n; ++i) parent[i] = i;
+    }
+    int find(int x) {
+        while (parent[x] != x) x = parent[x] = parent[parent[x]];
+        return x;
+    }
+    bool merge(int x, int y) {
+        x = find(x); y = find(y);
+        if (x == y) return false;
+        if (size[x] < size[y]) std::swap(x, y);
+        parent[y] = x;
+        size[x] += size[y];
+        return true;
+    }
+};
+
+// Shortest string on which the product automaton reaches a pair with
+// different tags (the caller knows there is one)
+static void shortestCounterexample(const EquivSide &a, const EquivSide &b,
+                                   const std::vector<int> &clsA, const std::vector<int> &clsB,
+                                   const std::vector<uint8_t> &rep, DFAEquivalence &out) {
+    struct Node { int p, q, parent; uint8_t byte; };
+    std::vector<Node> nodes;
+    std::unordered_map<uint64_t, int> seen;
+    auto key = [](int p, int q) { return (uint64_t)(uint32_t)p << 32 | (uint32_t)q; };
+    nodes.push_back({ a.start(), b.start(), -1, 0 });
+    seen[key(a.start(), b.start())] = 0;
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        Node n = nodes[k];
+        if (a.tag(n.p) != b.tag(n.q)) {
+            out.tagA = a.tag(n.p);
+            out.tagB = b.tag(n.q);
+            for (int i = (int)k; nodes[i].parent >= 0; i = nodes[i].parent)
+                out.counterexample.insert(out.counterexample.begin(), (char)nodes[i].byte);
+            return;
+        }
+        if (n.p == a.dead && n.q == b.dead) continue;
+        for (size_t c = 0; c < rep.size(); ++c) {
+            int p = a.step(n.p, clsA[c]), q = b.step(n.q, clsB[c]);
+            if (seen.emplace(key(p, q), (int)nodes.size()).second) nodes.push_back({ p, q, (int)k, rep[c] });
+        }
+    }
+}
+
+DFAEquivalence dfaEquivalent(const DFAView &va, const DFAView &vb) {
+    DFAEquivalence out;
+    EquivSide a(va), b(vb);
+
+    // joint classes: bytes that both class maps put in the same class
+    std::vector<int> joint((size_t)va.alphabet * vb.alphabet, -1);
+    std::vector<int> clsA, clsB;
+    std::vector<uint8_t> rep;
+    for (int c = 0; c < 256; ++c) {
+        int ca = va.numStates ? va.classOf[c] : 0, cb = vb.numStates ? vb.classOf[c] : 0;
+        int &j = joint[(size_t)ca * vb.alphabet + cb];
+        if (j >= 0) continue;
+        j = (int)rep.size();
+        clsA.push_back(ca);
+        clsB.push_back(cb);
+        rep.push_back((uint8_t)c);
+    }
+
+    // states of b are numbered after those of a (dead states included)
+    const int offset = va.numStates + 1;
+    StateUnion uf(offset + vb.numStates + 1);
+    std::vector<std::pair<int,int>> work;
+    uf.merge(a.start(), offset + b.start());
+    work.push_back({ a.start(), b.start() });
+    while (!work.empty()) {
+        auto [p, q] = work.back();
+        work.pop_back();
+        if (a.tag(p) != b.tag(q)) { out.equal = false; break; }
+        for (size_t c = 0; c < rep.size(); ++c) {
+            int np = a.step(p, clsA[c]), nq = b.step(q, clsB[c]);
+            if (uf.merge(np, offset + nq)) { ++out.merges; work.push_back({ np, nq }); }
+        }
+    }
+    if (!out.equal) shortestCounterexample(a, b, clsA, clsB, rep, out);
+    return out;
+}
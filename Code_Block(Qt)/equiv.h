@@ -0,0 +1,28 @@
+#ifndef EQUIV_H
+#define EQUIV_H
+
+#include "dfa.h"
+#include <string>
+
+// Language equivalence of two DFAs, accept tags included: both must accept
+// the same strings and report the same winning tag on each. Position tags
+// (tagdfa.h) are not compared, so a tagged lexer checks against its subset DFA.
+//
+// Hopcroft-Karp: the start states are merged in a union-find, and every pair
+// of states reached on the same byte from a merged pair is merged too; the
+// DFAs are equivalent when no merged pair disagrees on its tag. Bytes are
+// walked per joint class (classes of both class maps at once), so the check
+// costs about (states of both) * (joint classes) near-constant steps.
+// Only when they differ is the product automaton searched breadth-first for
+// the shortest string that tells them apart.
+
+struct DFAEquivalence {
+    bool equal = true;
+    std::string counterexample;     // shortest distinguishing input (may be empty)
+    int tagA = -1, tagB = -1;       // accept tags after it, -1 when not accepting
+    int merges = 0;                 // union-find merges of the equivalence pass
+};
+
+DFAEquivalence dfaEquivalent(const DFAView &a, const DFAView &b);
+
+#endif // EQUIV_H
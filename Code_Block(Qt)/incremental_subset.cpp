@@ -0,0 +1,122 @@
+#include "incremental_subset.h"
+#include <chrono>
+
+static int acceptTagOf(const NFA &n, int q) {
+    if (!n.accepts.count(q)) return -1;
+    auto t = n.acceptTag.find(q);
+    return t == n.acceptTag.end() ? 0 : t->second;
+}
+
+static int tagOfState(const NFA &n, int q) {
+    auto t = n.tagOf.find(q);
+    return t == n.tagOf.end() ? -1 : t->second;
+}
+
+std::vector<char> changedNFAStates(const NFA &before, const NFA &after) {
+    const int nb = (int)before.states.size(), na = (int)after.states.size();
+    std::vector<char> changed(std::max(nb, na), 1);
+    for (int q = 0; q < std::min(nb, na); ++q) {
+        const NFAState &b = before.states[q], &a = after.states[q];
+        changed[q] = b.trans != a.trans || b.eps != a.eps
+            || acceptTagOf(before, q) != acceptTagOf(after, q) || tagOfState(before, q) != tagOfState(after, q);
+    }
+    return changed;
+}
+
+DFA subsetConstructionIncremental(const DFA &old, const NFA &before, const NFA &after) {
+    // the old sets hold ids of the expanded NFA (flattenNFA), so compare those
+    if (!before.counterOf.empty() || !after.counterOf.empty())
+        return subsetConstructionIncremental(old, expandCounters(before), expandCounters(after));
+    auto t0 = std::chrono::steady_clock::now();
+    if ((int)old.rev.size() != old.numStates || old.numStates == 0 || before.start != after.start)
+        return subsetConstruction(after);
+    FlatNFA f = flattenNFA(after);
+    std::vector<char> changed = changedNFAStates(before, after);
+
+    // a row is reusable when its set and all its target sets avoid the changed states
+    std::vector<char> clean(old.numStates), reusable(old.numStates);
+    for (int o = 0; o < old.numStates; ++o) {
+        clean[o] = 1;
+        for (int q : old.rev[o]) if (changed[q]) { clean[o] = 0; break; }
+    }
+    NFASetTable oldSets;
+    for (int o = 0; o < old.numStates; ++o) {
+        reusable[o] = clean[o];
+        for (int c = 0; c < old.alphabet && reusable[o]; ++c) {
+            int t = old.step(o, c);
+            if (t != DFA_DEAD && !clean[t]) reusable[o] = 0;
+        }
+        oldSets.intern(old.rev[o]);
+    }
+
+    DFA d;
+    d.classOf = f.classOf;
+    d.alphabet = f.alphabet;
+    NFASetTable sets;
+    SubsetScratch scratch;
+    SubsetRow row;
+    NFASet cur;
+    std::vector<int> ids;
+    std::vector<int> accepting;
+    std::vector<int> oldOf;                    // new id -> old id with the same set, -1 if none
+    std::vector<int> newOf(old.numStates, -1); // old id -> new id once interned
+    int reused = 0;
+
+    auto internOld = [&](int o) {
+        if (newOf[o] >= 0) return newOf[o];
+        bool added = false;
+        int id = sets.intern(old.rev[o], &added);
+        if (added) { d.table.resize(d.table.size() + d.alphabet, DFA_DEAD); oldOf.push_back(o); }
+        newOf[o] = id;
+        return id;
+    };
+
+    cur.push_back(after.start);
+    epsClosureInto(f, cur, scratch);
+    sets.intern(cur);
+    oldOf.push_back(-2);
+    d.table.assign(d.alphabet, DFA_DEAD);
+
+    for (int i = 0; i < sets.size(); ++i) {
+        if (oldOf[i] == -2) {
+            oldOf[i] = oldSets.find(sets.at(i));
+            if (oldOf[i] >= 0) newOf[oldOf[i]] = i;
+        }
+        int o = oldOf[i];
+        if (o >= 0 && reusable[o]) {
+            // same row as before: old targets by class representative, interned in byte order
+            accepting.push_back(old.acceptTag[o]);
+            for (int c : f.classesByRep) {
+                int t = old.step(o, old.classOf[f.classRep[c]]);
+                if (t != DFA_DEAD) d.table[(size_t)i * d.alphabet + c] = internOld(t);
+            }
+            ++reused;
+            continue;
+        }
+        cur = sets.at(i);
+        accepting.push_back(subsetAcceptTag(f, cur));
+        expandSubsetState(f, cur, scratch, row);
+        ids.resize(row.count);
+        for (int k = 0; k < row.count; ++k) {
+            bool added = false;
+            ids[k] = sets.intern(row.targets[k], &added);
+            if (added) { d.table.resize(d.table.size() + d.alphabet, DFA_DEAD); oldOf.push_back(-2); }
+        }
+        for (size_t j = 0; j < row.cls.size(); ++j)
+            d.table[(size_t)i * d.alphabet + row.cls[j]] = ids[row.target[j]];
+    }
+
+    d.numStates = sets.size();
+    d.start = 0;
+    d.rev = sets.release();
+    d.acceptBits.assign((d.numStates + 63) / 64, 0);
+    d.acceptTag = accepting;
+    for (int id = 0; id < d.numStates; ++id)
+        if (accepting[id] >= 0) d.acceptBits[id >> 6] |= 1ull << (id & 63);
+    d.stats.nfaStates = f.numStates;
+    d.stats.statesBefore = d.stats.statesAfter = d.numStates;
+    d.stats.statesReused = reused;
+    packDFA(d);
+    d.stats.subsetMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return d;
+}
@@ -0,0 +1,27 @@
+#ifndef INCREMENTAL_SUBSET_H
+#define INCREMENTAL_SUBSET_H
+
+#include "dfa.h"
+
+// Incremental determinization for specs edited a piece at a time. A DFA
+// state is a closed NFA set, and its row depends only on the edges of its
+// own members and on the closures of its targets. So a state of the old DFA
+// keeps its row under the new NFA when neither its set nor any target set
+// contains a changed NFA state. Only the states around the edit are expanded
+// again; the rest are copied, with their targets mapped to the new ids.
+// Edits should keep NFA ids stable, i.e. add alternatives at the end and
+// unlink removed ones (addLexerAlternative / removeLexerAlternative in
+// lexspec.h); a renumbered NFA changes everywhere and reuses nothing.
+
+// NFA states whose labeled or eps edges, accept tag or position tag differ
+// between before and after, plus the states only one of them has
+// (result[q] != 0, sized for the larger NFA)
+std::vector<char> changedNFAStates(const NFA &before, const NFA &after);
+
+// subsetConstruction(after), reusing the rows of old, the subset DFA of
+// before (old.rev must hold its NFA sets, as subsetConstruction leaves it).
+// The result is identical to subsetConstruction(after); stats.statesReused
+// counts the copied rows.
+DFA subsetConstructionIncremental(const DFA &old, const NFA &before, const NFA &after);
+
+#endif // INCREMENTAL_SUBSET_H
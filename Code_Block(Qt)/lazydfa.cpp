@@ -0,0 +1,103 @@
+#include "lazydfa.h"
+
+LazyDFA::LazyDFA(const NFA &n, size_t memoryBudget)
+    : m_nfa(flattenNFA(n, true)), m_budget(memoryBudget) {
+    if (n.start < 0) return; // empty NFA: m_start stays -1 and nothing matches
+    if (!m_nfa.counters.empty()) {
+        countingStart(m_nfa, m_startConfig, m_scratch);
+        m_start = addConfig(m_startConfig);
+        return;
+    }
+    m_startSet.push_back(n.start);
+    epsClosureInto(m_nfa, m_startSet, m_scratch);
+    m_start = addState(m_startSet);
+}
+
+int LazyDFA::addState(const NFASet &set) {
+    bool added = false;
+    int id = m_sets.intern(set, &added);
+    if (!added) return id;
+    m_acceptTag.push_back(subsetAcceptTag(m_nfa, set));
+    m_rows.resize(m_rows.size() + m_nfa.alphabet, LAZY_UNKNOWN);
+    m_stats.states = m_sets.size();
+    m_stats.setSizes += set.size();
+    m_stats.bytes += m_nfa.alphabet * sizeof(int32_t) + set.size() * sizeof(int) + sizeof(NFASet) + 32;
+    return id;
+}
+
+// Cached state of a counting configuration, interned by countingKey
+int LazyDFA::addConfig(const CountingSet &config) {
+    countingKey(config, m_key);
+    bool added = false;
+    int id = m_sets.intern(m_key, &added);
+    if (!added) return id;
+    m_configs.push_back(config);
+    m_acceptTag.push_back(countingAcceptTag(m_nfa, config));
+    m_rows.resize(m_rows.size() + m_nfa.alphabet, LAZY_UNKNOWN);
+    m_stats.states = m_sets.size();
+    m_stats.setSizes += config.states.size();
+    m_stats.bytes += m_nfa.alphabet * sizeof(int32_t) + 2 * m_key.size() * sizeof(int)
+                     + config.counts.size() * sizeof(uint64_t) + sizeof(CountingSet) + sizeof(NFASet) + 32;
+    return id;
+}
+
+void LazyDFA::flush() {
+    m_sets.clear();
+    m_rows.clear();
+    m_acceptTag.clear();
+    m_configs.clear();
+    m_stats.bytes = 0;
+    ++m_stats.flushes;
+    m_start = m_nfa.counters.empty() ? addState(m_startSet) : addConfig(m_startConfig);
+}
+
+// Next state of s on class cls, determinizing it on a miss. A flush renumbers
+// the cache, so s is updated to the id of the same NFA set afterwards.
+int LazyDFA::transition(int &s, int cls) {
+    int32_t cell = m_rows[(size_t)s * m_nfa.alphabet + cls];
+    if (cell != LAZY_UNKNOWN) { ++m_stats.hits; return cell; }
+    ++m_stats.misses;
+
+    int target = DFA_DEAD;
+    if (!m_nfa.counters.empty()) {
+        countingStep(m_nfa, m_configs[s], m_nfa.classRep[cls], m_nextConfig, m_scratch);
+        if (!m_nextConfig.states.empty()) {
+            if (m_stats.bytes > m_budget) {
+                m_keepConfig = m_configs[s];
+                flush();
+                s = addConfig(m_keepConfig);
+            }
+            target = addConfig(m_nextConfig);
+        }
+        m_rows[(size_t)s * m_nfa.alphabet + cls] = target;
+        return target;
+    }
+    moveOnClassInto(m_nfa, m_sets.at(s), cls, m_moved, m_scratch);
+    if (!m_moved.empty()) {
+        epsClosureInto(m_nfa, m_moved, m_scratch);
+        if (m_stats.bytes > m_budget) {
+            m_keep = m_sets.at(s);
+            flush();
+            s = addState(m_keep);
+        }
+        target = addState(m_moved);
+    }
+    m_rows[(size_t)s * m_nfa.alphabet + cls] = target;
+    return target;
+}
+
+// Longest match from pos; *tag gets the winning accept tag (-1 when none)
+int LazyDFA::longestMatch(const std::string &s, int pos, int *tag) {
+    const unsigned char *p = (const unsigned char *)s.data();
+    int cur = m_start;
+    int lastAcceptPos = -1, lastTag = -1;
+    if (cur < 0) { if (tag) *tag = -1; return 0; }
+    for (int i = pos; i < (int)s.size(); ++i) {
+        int nxt = transition(cur, m_nfa.classOf[p[i]]);
+        if (nxt == DFA_DEAD) break;
+        cur = nxt;
+        if (m_acceptTag[cur] >= 0) { lastAcceptPos = i; lastTag = m_acceptTag[cur]; }
+    }
+    if (tag) *tag = lastTag;
+    return lastAcceptPos >= 0 ? (lastAcceptPos - pos + 1) : 0;
+}
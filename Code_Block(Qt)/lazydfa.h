@@ -0,0 +1,58 @@
+#ifndef LAZYDFA_H
+#define LAZYDFA_H
+
+#include "dfa.h"
+#include "counting.h"
+#include <string>
+
+// Cell value of a transition that has not been determinized yet
+const int32_t LAZY_UNKNOWN = -2;
+
+// Cache counters of the lazy matcher
+struct LazyDFAStats {
+    uint64_t hits = 0;      // transitions served from the cache
+    uint64_t misses = 0;    // transitions determinized on first use
+    uint64_t flushes = 0;   // times the cache hit the memory budget and was cleared
+    size_t states = 0;      // DFA states currently cached
+    uint64_t setSizes = 0;  // NFA states summed over every set determinized
+    size_t bytes = 0;       // approximate cache footprint
+};
+
+// On-the-fly DFA: keeps the NFA and determinizes states and transitions on
+// first use. When the cache grows past memoryBudget bytes it is cleared and
+// rebuilt from the states the current match still needs. Counted loops
+// (repeatFrag) stay counters: a cached state is an NFA set plus its counts
+// (counting.h), so only the counts the input reaches are ever determinized.
+class LazyDFA {
+public:
+    explicit LazyDFA(const NFA &n, size_t memoryBudget = 1 << 20);
+
+    // Longest match from pos; *tag gets the winning accept tag (-1 when none)
+    int longestMatch(const std::string &s, int pos, int *tag);
+
+    const LazyDFAStats &stats() const { return m_stats; }
+    size_t memoryBudget() const { return m_budget; }
+
+private:
+    FlatNFA m_nfa;
+    size_t m_budget;
+    NFASet m_startSet;
+    int m_start = -1;
+    NFASetTable m_sets;
+    std::vector<int32_t> m_rows;    // alphabet cells per cached state, LAZY_UNKNOWN until computed
+    std::vector<int> m_acceptTag;   // cached state -> winning tag, -1 if not accepting
+    SubsetScratch m_scratch;
+    NFASet m_moved, m_keep;
+    LazyDFAStats m_stats;
+    // counting NFAs only: configuration of each cached state
+    std::vector<CountingSet> m_configs;
+    CountingSet m_startConfig, m_nextConfig, m_keepConfig;
+    NFASet m_key;
+
+    int addState(const NFASet &set);
+    int addConfig(const CountingSet &config);
+    int transition(int &s, int cls);
+    void flush();
+};
+
+#endif // LAZYDFA_H
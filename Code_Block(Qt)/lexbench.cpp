@@ -0,0 +1,866 @@
+#include "tokenizer.h"
+#include "direct_scanner.h"
+#include "dfaio.h"
+#include "static_dfa.h"
+#include "matcher.h"
+#include "profile.h"
+#include "incremental_subset.h"
+#include "equiv.h"
+#include "minimize.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+// Throughput of the table-driven and the direct-coded lexer on the same input,
+// of one-at-a-time vs batched matching over many small code blocks, of the
+// BFS vs the profile-guided state layout, of full vs incremental
+// determinization after a spec edit, of the equivalence check that gates a
+// rebuilt table, of full vs packed provenance, of plain vs memoized maximal munch,
+// of Number captures from the tagged lexer vs a second pass over the tokens,
+// then of the table, static and shuffle engines on identifier- and number-heavy text,
+// of bounded repetition kept as counters vs expanded into copies,
+// and last every engine against the one the planner (planner.h) picks, with
+// its costs calibrated on this machine. Exits with 1 when the direct scanner
+// is stale, engines disagree on the tokens or a pick's median time is slower
+// than the fastest engine's by more than their run-to-run noise.
+// Usage: lexbench [megabytes] [rounds]
+static std::string makeInput(size_t bytes) {
+    static const char *sample =
+        "int main() {\n"
+        "    float total = 0.5;\n"
+        "    for (int i = 0; i < 1000; i = i + 1) {\n"
+        "        if (i % 3 == 0 && flag_value != 17) { total = total * 2.25 - i; }\n"
+        "        else { counter_variable = counter_variable + 1; }\n"
+        "    }\n"
+        "    while (x >= 42) { x = x / 2; continue; }\n"
+        "    return total;\n"
+        "}\n";
+    std::string s;
+    while (s.size() < bytes) s += sample;
+    return s;
+}
+
+// Tokens a match-only pass found and a digest of their (length, tag) pairs
+// in input order, so two matchers are compared token by token, not by count
+struct MatchTally {
+    size_t tokens = 0;
+    uint64_t digest = 14695981039346656037ull;
+    void add(int len, int tag) {
+        ++tokens;
+        digest = (digest ^ ((uint64_t)(uint32_t)len << 32 | (uint32_t)tag)) * 1099511628211ull;
+    }
+    bool operator!=(const MatchTally &o) const { return tokens != o.tokens || digest != o.digest; }
+};
+
+template <typename Match>
+static double matchOnly(const std::string &in, Match match, MatchTally *tally) {
+    auto t0 = std::chrono::steady_clock::now();
+    MatchTally sum;
+    for (int i = 0, n = (int)in.size(); i < n;) {
+        int tag = -1;
+        int len = match(in, i, &tag);
+        if (len > 0) { sum.add(len, tag); i += len; } else ++i;
+    }
+    *tally = sum;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+template <typename Tokenize>
+static double tokenizeAll(Tokenize tokenize, std::vector<TokenItem> *tokens) {
+    auto t0 = std::chrono::steady_clock::now();
+    *tokens = tokenize();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// True when a and b agree on every token: kind, text, line, column and
+// captures. Prints the first difference.
+static bool sameTokens(const std::vector<TokenItem> &a, const std::vector<TokenItem> &b) {
+    for (size_t k = 0; k < std::min(a.size(), b.size()); ++k) {
+        const TokenItem &x = a[k], &y = b[k];
+        bool same = x.type == y.type && x.text == y.text && x.line == y.line && x.col == y.col;
+        if (same) {
+            same = x.captures.size() == y.captures.size();
+            for (size_t c = 0; same && c < x.captures.size(); ++c)
+                same = x.captures[c].begin == y.captures[c].begin && x.captures[c].length == y.captures[c].length;
+        }
+        if (!same) {
+            std::printf("tokens differ at %zu: %s '%s' %d:%d vs %s '%s' %d:%d\n", k, x.type.c_str(), x.text.c_str(),
+                        x.line, x.col, y.type.c_str(), y.text.c_str(), y.line, y.col);
+            return false;
+        }
+    }
+    if (a.size() == b.size()) return true;
+    std::printf("token counts differ: %zu vs %zu\n", a.size(), b.size());
+    return false;
+}
+
+// Code blocks of about 700 bytes made of C-like tokens in random order (a
+// repeated sample would let the branch predictor learn the token sequence)
+static std::vector<std::string> makeBlocks(size_t bytes) {
+    static const char *vocab[] = {
+        "int", "float", "x", "i", "total", "counter_value", "flag", "=", "==", "<=",
+        "+", "*", "(", ")", "{", "}", ";", "42", "3.14", "1000", "while", "if", "return",
+    };
+    const size_t vocabSize = sizeof(vocab) / sizeof(vocab[0]);
+    std::vector<std::string> blocks;
+    unsigned seed = 5;
+    auto rnd = [&seed]() { seed = seed * 1103515245 + 12345; return seed >> 16; };
+    for (size_t total = 0; total < bytes; total += blocks.back().size()) {
+        blocks.emplace_back();
+        while (blocks.back().size() < 700) {
+            blocks.back() += vocab[rnd() % vocabSize];
+            blocks.back() += rnd() % 8 ? ' ' : '\n';
+        }
+    }
+    return blocks;
+}
+
+// Match-only pass over every block, streams blocks at a time in lockstep
+// (streams == 1: dfaLongestMatchTagged per token). Each block is tallied on
+// its own, since lanes finish blocks out of order, and the tallies are then
+// folded in block order.
+static double matchBlocks(const std::vector<std::string> &blocks, const DFAView &view, int streams, MatchTally *tally) {
+    std::vector<MatchTally> perBlock(blocks.size());
+    auto t0 = std::chrono::steady_clock::now();
+    if (streams == 1) {
+        for (size_t k = 0; k < blocks.size(); ++k)
+            for (int i = 0, n = (int)blocks[k].size(); i < n;) {
+                int tag = -1;
+                int len = dfaLongestMatchTagged(view, blocks[k], i, &tag);
+                if (len > 0) { perBlock[k].add(len, tag); i += len; } else ++i;
+            }
+    } else {
+        // every lane walks one block and takes the next block when it is done
+        MatchStream batch[MATCH_BATCH_MAX];
+        size_t next = 0;
+        int live = 0;
+        for (; live < streams && next < blocks.size(); ++live) {
+            batch[live].input = &blocks[next++];
+            batch[live].pos = 0;
+        }
+        matchStreams(view, batch, live, [&](int, MatchStream &m) {
+            if (m.len > 0) { perBlock[m.input - blocks.data()].add(m.len, m.tag); m.pos += m.len; } else ++m.pos;
+            if (m.pos < (int)m.input->size()) return true;
+            if (next == blocks.size()) return false;
+            m.input = &blocks[next++];
+            m.pos = 0;
+            return true;
+        });
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    MatchTally sum;
+    for (const MatchTally &b : perBlock) {
+        sum.tokens += b.tokens;
+        sum.digest = (sum.digest ^ b.digest) * 1099511628211ull;
+    }
+    *tally = sum;
+    return secs;
+}
+
+// Random lowercase words of 6..14 letters and a trie DFA accepting exactly
+// them: with tens of thousands of words its table is far larger than the
+// caches, so every transition is a likely miss
+static DFA makeKeywordDFA(std::vector<std::string> &words, int count) {
+    unsigned seed = 7;
+    auto rnd = [&seed]() { seed = seed * 1103515245 + 12345; return seed >> 16; };
+    NFA n;
+    n.start = n.newState();
+    std::vector<std::map<char, int>> child(1);
+    for (int k = 0; k < count; ++k) {
+        std::string w;
+        for (int len = 6 + (int)(rnd() % 9); (int)w.size() < len;) w += (char)('a' + rnd() % 26);
+        int s = n.start;
+        for (char c : w) {
+            auto it = child[s].find(c);
+            if (it != child[s].end()) { s = it->second; continue; }
+            int t = n.newState();
+            child.emplace_back();
+            child[s][c] = t;
+            n.addTrans(s, c, t);
+            s = t;
+        }
+        n.accepts.insert(s);
+        words.push_back(w);
+    }
+    DFA d = subsetConstruction(n);
+    packDFA(d);
+    return d;
+}
+
+// Words separated by blanks, word k drawn with probability ~ 1/(k+1)
+static std::string zipfText(const std::vector<std::string> &words, size_t bytes, unsigned seed) {
+    std::vector<double> cdf(words.size());
+    double sum = 0;
+    for (size_t k = 0; k < words.size(); ++k) cdf[k] = sum += 1.0 / (double)(k + 1);
+    std::string s;
+    while (s.size() < bytes) {
+        seed = seed * 1103515245 + 12345;
+        double u = (double)(seed >> 8) / (double)(1u << 24) * sum;
+        size_t k = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        s += words[std::min(k, words.size() - 1)];
+        s += ' ';
+    }
+    return s;
+}
+
+// Words of 1..maxLen identifier (or number) characters between separators
+static std::string makeWords(size_t bytes, bool numbers, int maxLen) {
+    static const char idStart[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+    static const char idRest[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+    std::string s;
+    unsigned seed = 9;
+    auto rnd = [&seed]() { seed = seed * 1103515245 + 12345; return seed >> 16; };
+    while (s.size() < bytes) {
+        int len = 1 + (int)(rnd() % maxLen);
+        for (int k = 0; k < len; ++k) {
+            if (!numbers) s += k ? idRest[rnd() % (sizeof(idRest) - 1)] : idStart[rnd() % (sizeof(idStart) - 1)];
+            else if (k && k + 1 < len && s.back() != '.' && rnd() % 8 == 0) s += '.';
+            else s += (char)('0' + rnd() % 10);
+        }
+        s += " ,;("[rnd() % 4];
+    }
+    return s;
+}
+
+static void report(const char *name, double secs, size_t bytes, size_t tokens) {
+    std::printf("%-22s %8.1f MB/s  %10zu tokens\n", name, bytes / secs / 1e6, tokens);
+}
+
+// Best of three wall times of run, in ns
+template <typename Run>
+static double bestNs(Run run) {
+    double best = -1;
+    for (int r = 0; r < 3; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        run();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        if (best < 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+// Numbers like 7, 1234 and 3.25 between blanks, for the number DFA
+static std::string numberWords(size_t bytes) {
+    std::string s;
+    unsigned seed = 1;
+    while (s.size() < bytes) {
+        seed = seed * 1103515245 + 12345;
+        s += std::to_string((seed >> 8) % 100000);
+        if (seed & 0x10) s += "." + std::to_string((seed >> 4) % 100);
+        s += ' ';
+    }
+    return s;
+}
+
+// Fits the planner's LexCosts (planner.h) to this machine: times each engine
+// on corpus (repeated to 32 KB, and to 512 KB for the loop growth), the
+// table, memo, lazy DFA and NFA simulator on lexer and its spec, and the
+// shuffle engine against the table on the built-in number DFA. Each engine's
+// cost is its measured ns per byte minus the parts of the model that are not
+// calibrated (table step, set-up, lazy misses); the loop is what the untagged
+// table run leaves after its step.
+static LexCosts calibrateLexCosts(const DFAView &lexer, const NFA &spec, const std::vector<std::string> &corpus) {
+    LexCosts c = lexCosts();
+    std::string sample, large;
+    while (sample.size() < LEX_CALIBRATION_BYTES && !corpus.empty())
+        for (const std::string &s : corpus) sample += s;
+    if (sample.empty() || lexer.numStates == 0 || lexer.lookahead < 0) return c;
+    while (large.size() < LEX_CALIBRATION_BYTES * 16) large += sample;
+    const double n = (double)sample.size();
+    LexFeatures f = lexFeatures(lexer, sample.size(), 1);
+    if (!spec.states.empty()) addSpecFeatures(f, spec);
+
+    DFAView plain = lexer;
+    plain.numTags = 0;
+    const double table = bestNs([&] { tokenizeWithEngine(sample, plain, ENGINE_TABLE); }) / n;
+    c.loop = std::max(1.0, table - lexTableStepNs(f));
+    double tableLarge = bestNs([&] { tokenizeWithEngine(large, plain, ENGINE_TABLE); }) / (double)large.size();
+    c.loopGrowth = std::max(0.0, (tableLarge - table) / std::log2((double)large.size() / n));
+    if (lexer.numTags > 0) {
+        double tagged = bestNs([&] { tokenizeWithEngine(sample, lexer, ENGINE_TABLE); }) / n;
+        c.tag = std::max(0.0, (tagged - table) / lexer.numTags);
+    }
+    c.memo = std::max(0.0, bestNs([&] { tokenizeMemoized(sample, plain); }) / n - table);
+
+    // a | a*b on a run of a's: the first scan records every pair of the run,
+    // the worst case predict prices the memo's records by
+    NFA rescan;
+    rescan.start = rescan.newState();
+    Fragment single = makeChar(rescan, 'a');
+    Fragment longer = concatFrag(rescan, starFrag(rescan, makeChar(rescan, 'a')), makeChar(rescan, 'b'));
+    for (Fragment frag : { single, longer }) {
+        rescan.addEps(rescan.start, frag.start);
+        rescan.accepts.insert(frag.accept);
+    }
+    DFA rescanDfa = subsetConstruction(rescan);
+    std::string run(LEX_CALIBRATION_BYTES / 4, 'a');
+    LexFeatures rf = lexFeatures(rescanDfa.view(), run.size(), 1);
+    double memoRun = bestNs([&] { tokenizeMemoized(run, rescanDfa.view()); }) / (double)run.size();
+    c.memoRecord = std::max(0.0, memoRun - c.loop - lexTableStepNs(rf) - c.memo);
+
+    if (f.nfaStates > 0) {
+        const double setup = lexSpecSetupNs(f);
+        // on a warm cache, so the step is not mixed up with the misses
+        LazyDFA warm(spec);
+        tokenizeWithDFA(sample, warm);
+        c.lazyStep = std::max(1.0, bestNs([&] { tokenizeWithDFA(sample, warm); }) / n - c.loop);
+        double nfa = bestNs([&] { NFASimulator s(spec); tokenizeWithNFA(sample, s); });
+        c.nfaState = std::max(0.5, ((nfa - setup) / n - c.loop) / lexSetSize(f));
+        c.compile = bestNs([&] { compileLexerDFA(spec); }) / f.nfaStates;
+    }
+
+    // the lexer has no shuffle table; the number DFA does, and the shuffle
+    // step is priced by how it compares to the table step there
+    DFA number = staticToDFA(numberTable);
+    if (!number.sheng.empty() && shengSupported()) {
+        std::string words = numberWords(sample.size());
+        const double m = (double)words.size();
+        LexFeatures nf = lexFeatures(number.view(), words.size(), 1);
+        double tableNs = bestNs([&] { tokenizeWithEngine(words, number.view(), ENGINE_TABLE); }) / m;
+        double shengNs = bestNs([&] { tokenizeWithEngine(words, number.view(), ENGINE_SHENG); }) / m;
+        c.shengStep = std::max(0.25, lexTableStepNs(nf) + shengNs - tableNs);
+    }
+    return c;
+}
+
+// One planner check: a lexer, compiled or given by its token spec only, and an input
+struct PlanCase {
+    const char *name;
+    const NFA *spec;            // nullptr: the compiled lexer only
+    const DFAView *view;        // nullptr: not compiled yet
+    std::string input;
+    double lazyMissRate = -1;   // fed back from an earlier lazy run
+    double lazySetSize = -1;
+};
+
+// Runs per engine of a planner check, whatever the rounds argument, so the
+// median is not one sample
+const int PLAN_MIN_ROUNDS = 5;
+// A pick passes when its median is within this much of the fastest median,
+// widened by the spread the two engines showed over their runs
+const double PLAN_TOLERANCE = 0.10;
+
+// Median ms of one engine on c over its runs, set-up included: the lazy DFA
+// and the NFA simulator are built from the spec, and a spec not compiled yet
+// is determinized before a table engine runs. *spread gets (max - min) / median.
+static double timeEngine(const PlanCase &c, LexEngine e, int rounds, std::vector<TokenItem> *tokens, double *spread) {
+    std::vector<double> runs;
+    for (int r = 0; r < std::max(rounds, PLAN_MIN_ROUNDS); ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<TokenItem> out;
+        if (e == ENGINE_LAZY) {
+            LazyDFA lazy(*c.spec);
+            out = tokenizeWithDFA(c.input, lazy);
+        } else if (e == ENGINE_NFA) {
+            NFASimulator sim(*c.spec);
+            out = tokenizeWithNFA(c.input, sim);
+        } else if (c.view) {
+            out = tokenizeWithEngine(c.input, *c.view, e);
+        } else {
+            DFA d = compileLexerDFA(*c.spec);
+            out = tokenizeWithEngine(c.input, d.view(), e);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        *tokens = std::move(out);
+        runs.push_back(ms);
+    }
+    std::sort(runs.begin(), runs.end());
+    double median = runs[runs.size() / 2];
+    *spread = median > 0 ? (runs.back() - runs.front()) / median : 0;
+    return median;
+}
+
+// Times every engine the planner considers for c; false when the engines
+// disagree on the tokens. *ok is set when the pick's median is within
+// PLAN_TOLERANCE plus the run-to-run spread of the fastest median.
+static bool checkPlan(const PlanCase &c, int rounds, bool *ok) {
+    LexFeatures f = lexFeatures(c.view ? *c.view : DFAView(), c.input.size());
+    if (c.spec) addSpecFeatures(f, *c.spec);
+    f.lazyMissRate = c.lazyMissRate;
+    f.lazySetSize = c.lazySetSize;
+    LexPlan plan = planLexer(f);
+    std::printf("%s, %zu bytes: planned %s%s, %.2f ms expected (%s)\n", c.name, c.input.size(),
+                plan.compile ? "compile + " : "", lexEngineName(plan.engine), plan.expectedMs, plan.reason);
+    double ms[ENGINE_COUNT], spread[ENGINE_COUNT];
+    int fastest = -1;
+    std::vector<TokenItem> tokens;
+    for (int e = 0; e < ENGINE_COUNT; ++e) {
+        ms[e] = -1;
+        if (plan.costMs[e] < 0) continue;
+        std::vector<TokenItem> tok;
+        ms[e] = timeEngine(c, (LexEngine)e, rounds, &tok, &spread[e]);
+        std::printf("  %-10s %9.2f ms measured (spread %3.0f%%) %9.2f ms expected\n", lexEngineName((LexEngine)e),
+                    ms[e], spread[e] * 100, plan.costMs[e]);
+        if (fastest >= 0 && !sameTokens(tokens, tok)) return false;
+        tokens = std::move(tok);
+        if (fastest < 0 || ms[e] < ms[fastest]) fastest = e;
+    }
+    double tolerance = fastest < 0 ? 0 : PLAN_TOLERANCE + std::max(spread[plan.engine], spread[fastest]);
+    *ok = fastest < 0 || ms[plan.engine] <= ms[fastest] * (1 + tolerance);
+    if (!*ok) std::printf("  planned engine is %.0f%% slower than %s\n",
+                          (ms[plan.engine] / ms[fastest] - 1) * 100, lexEngineName((LexEngine)fastest));
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    size_t mb = argc > 1 ? (size_t)std::atoi(argv[1]) : 16;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 3;
+    std::string in = makeInput(mb << 20);
+    DFA lexer = buildLexerDFA();
+    DFAView view = lexer.view();
+    bool inSync = hashNFASpec(buildLexerNFA_thompson()) == directScannerSpecHash;
+    std::printf("input %zu bytes, lexer %d states / %d classes, spec %s\n", in.size(),
+                lexer.numStates, lexer.alphabet, inSync ? "in sync" : "STALE");
+    if (!inSync) return 1;
+
+    for (int r = 0; r < rounds; ++r) {
+        MatchTally matchT, matchD;
+        double t = matchOnly(in, [&view](const std::string &s, int pos, int *tag) {
+            return dfaLongestMatchTagged(view, s, pos, tag);
+        }, &matchT);
+        double d = matchOnly(in, [](const std::string &s, int pos, int *tag) {
+            return directLongestMatch(s, pos, tag, nullptr);
+        }, &matchD);
+        report("match/table", t, in.size(), matchT.tokens);
+        report("match/direct", d, in.size(), matchD.tokens);
+        if (matchT != matchD) { std::printf("matches differ\n"); return 1; }
+
+        std::vector<TokenItem> tokT, tokD;
+        t = tokenizeAll([&] { return tokenizeWithDFA(in, view); }, &tokT);
+        d = tokenizeAll([&] { return tokenizeDirect(in); }, &tokD);
+        report("tokenize/table", t, in.size(), tokT.size());
+        report("tokenize/direct", d, in.size(), tokD.size());
+        if (!sameTokens(tokT, tokD)) return 1;
+        tokD.clear();
+
+        std::vector<TokenItem> tokP;
+        double p = tokenizeAll([&] { return tokenizeParallel(in, view); }, &tokP);
+        report("tokenize/table/par", p, in.size(), tokP.size());
+        if (!sameTokens(tokT, tokP)) return 1;
+    }
+
+    // many small inputs: one stream at a time vs lockstep batches
+    std::vector<std::string> blocks = makeBlocks(in.size());
+    size_t blockBytes = 0;
+    for (const std::string &b : blocks) blockBytes += b.size();
+    std::printf("%zu blocks\n", blocks.size());
+    for (int r = 0; r < rounds; ++r) {
+        MatchTally match1;
+        double one = matchBlocks(blocks, view, 1, &match1);
+        report("blocks/match/x1", one, blockBytes, match1.tokens);
+        for (int streams : { 4, 8, 16 }) {
+            MatchTally matchB;
+            double b = matchBlocks(blocks, view, streams, &matchB);
+            char name[32];
+            std::snprintf(name, sizeof name, "blocks/match/x%d", streams);
+            report(name, b, blockBytes, matchB.tokens);
+            if (matchB != match1) { std::printf("matches differ\n"); return 1; }
+        }
+
+        std::vector<std::vector<TokenItem>> seq, bat;
+        auto t0 = std::chrono::steady_clock::now();
+        for (const std::string &b : blocks) seq.push_back(tokenizeWithDFA(b, view));
+        double ts = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        t0 = std::chrono::steady_clock::now();
+        bat = tokenizeBatch(blocks, view);
+        double tb = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        size_t tokS = 0, tokB = 0;
+        for (size_t k = 0; k < blocks.size(); ++k) {
+            tokS += seq[k].size();
+            tokB += bat[k].size();
+            if (!sameTokens(seq[k], bat[k])) { std::printf("block %zu differs\n", k); return 1; }
+        }
+        report("blocks/tokenize/x1", ts, blockBytes, tokS);
+        report("blocks/tokenize/batch", tb, blockBytes, tokB);
+    }
+
+    // the same on a DFA whose table does not fit in the caches
+    std::vector<std::string> words;
+    DFA keywords = makeKeywordDFA(words, 40000);
+    std::vector<std::string> text(blocks.size());
+    unsigned seed = 11;
+    for (std::string &b : text)
+        while (b.size() < 700) {
+            seed = seed * 1103515245 + 12345;
+            b += words[(seed >> 16) % words.size()];
+            b += ' ';
+        }
+    size_t textBytes = 0;
+    for (const std::string &b : text) textBytes += b.size();
+    std::printf("keyword DFA, %d states, %zu KB table\n", keywords.numStates,
+                (keywords.table.size() * 4 + keywords.table16.size() * 2) >> 10);
+    for (int r = 0; r < rounds; ++r) {
+        MatchTally match1;
+        double one = matchBlocks(text, keywords.view(), 1, &match1);
+        report("  keywords/x1", one, textBytes, match1.tokens);
+        for (int streams : { 4, 8, 16 }) {
+            MatchTally matchB;
+            double b = matchBlocks(text, keywords.view(), streams, &matchB);
+            char name[32];
+            std::snprintf(name, sizeof name, "  keywords/x%d", streams);
+            report(name, b, textBytes, matchB.tokens);
+            if (matchB != match1) { std::printf("matches differ\n"); return 1; }
+        }
+    }
+
+    // BFS state numbering vs the profile-guided hot-first layout (profile.h)
+    DFA profiled = lexer;
+    applyProfileLayout(profiled, lexerTrainingCorpus());
+    std::printf("profiled lexer: %d of %d states hot\n", profiled.hotStates, profiled.numStates);
+    std::vector<std::string> zipfSample = { zipfText(words, 1 << 20, 3) }, zipfBlocks;
+    for (size_t k = 0; k < blocks.size(); ++k) zipfBlocks.push_back(zipfText(words, 700, 100 + (unsigned)k));
+    DFA hotKeywords = keywords;
+    applyProfileLayout(hotKeywords, zipfSample);
+    std::printf("profiled keyword DFA: %d of %d states hot (Zipf-distributed words)\n",
+                hotKeywords.hotStates, hotKeywords.numStates);
+    size_t zipfBytes = 0;
+    for (const std::string &b : zipfBlocks) zipfBytes += b.size();
+    for (int r = 0; r < rounds; ++r) {
+        MatchTally matchA, matchB;
+        double a = matchBlocks(blocks, view, 1, &matchA);
+        double b = matchBlocks(blocks, profiled.view(), 1, &matchB);
+        report("lexer/bfs", a, blockBytes, matchA.tokens);
+        report("lexer/profiled", b, blockBytes, matchB.tokens);
+        if (matchA != matchB) { std::printf("matches differ\n"); return 1; }
+        a = matchBlocks(zipfBlocks, keywords.view(), 1, &matchA);
+        b = matchBlocks(zipfBlocks, hotKeywords.view(), 1, &matchB);
+        report("keywords/bfs", a, zipfBytes, matchA.tokens);
+        report("keywords/profiled", b, zipfBytes, matchB.tokens);
+        if (matchA != matchB) { std::printf("matches differ\n"); return 1; }
+    }
+
+    // adjacent ranges of two members to one target ('a' from one, 'b' from
+    // the other) must give one target set, not a set holding it twice
+    NFA adjacent;
+    adjacent.start = adjacent.newState();
+    int adjA = adjacent.newState(), adjB = adjacent.newState(), adjT = adjacent.newState();
+    adjacent.addEps(adjacent.start, adjA);
+    adjacent.addEps(adjacent.start, adjB);
+    adjacent.addTrans(adjA, 'a', adjT);
+    adjacent.addTrans(adjB, 'b', adjT);
+    adjacent.accepts.insert(adjT);
+    if (subsetConstruction(adjacent).numStates != 2) { std::printf("adjacent ranges split a target set\n"); return 1; }
+
+    // spec edits on the lexer grown by 3000 keywords: one keyword added, then
+    // one removed, determinized from scratch vs from the previous subset DFA
+    NFA bigSpec = buildLexerNFA_thompson();
+    std::vector<int> wordAlts;
+    for (int k = 0; k < 3000; ++k) wordAlts.push_back(addLexerLiteral(bigSpec, words[k], TOK_KEYWORD));
+    DFA bigSubset = subsetConstruction(bigSpec);
+    NFA withWord = bigSpec, withoutWord = bigSpec;
+    addLexerLiteral(withWord, "zebrafish", TOK_KEYWORD);
+    removeLexerAlternative(withoutWord, wordAlts[1500]);
+    std::printf("lexer + 3000 keywords: %d subset states\n", bigSubset.numStates);
+    for (int r = 0; r < rounds; ++r) {
+        for (const NFA *edited : { &withWord, &withoutWord }) {
+            DFA full = subsetConstruction(*edited);
+            DFA inc = subsetConstructionIncremental(bigSubset, bigSpec, *edited);
+            std::printf("  %s: full %7.2f ms, incremental %7.2f ms (%d of %d rows reused)\n",
+                        edited == &withWord ? "add   " : "remove", full.stats.subsetMs, inc.stats.subsetMs,
+                        inc.stats.statesReused, inc.numStates);
+            if (full.numStates != inc.numStates) { std::printf("state counts differ\n"); return 1; }
+            // the app runs the same check after each incremental rebuild (loadOrBuildLexer)
+            DFAEquivalence same = dfaEquivalent(full.view(), inc.view());
+            if (!same.equal) {
+                std::printf("incremental DFA differs on \"%s\"\n", same.counterexample.c_str());
+                return 1;
+            }
+        }
+    }
+
+    // equivalence check: the keyword DFA against its minimized table, and the
+    // lexer + 3000 keywords against the same with one keyword more
+    DFA minKeywords = minimizeDFA(keywords);
+    packDFA(minKeywords);
+    for (int r = 0; r < rounds; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        DFAEquivalence same = dfaEquivalent(keywords.view(), minKeywords.view());
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        std::printf("equivalence, %d vs %d states: %s in %.2f ms\n", keywords.numStates, minKeywords.numStates,
+                    same.equal ? "equal" : "DIFFERENT", ms);
+        if (!same.equal) return 1;
+    }
+    DFA withWordSubset = subsetConstruction(withWord);
+    auto t0 = std::chrono::steady_clock::now();
+    DFAEquivalence diff = dfaEquivalent(bigSubset.view(), withWordSubset.view());
+    std::printf("equivalence after adding a keyword: \"%s\" is %s vs %s, found in %.2f ms\n",
+                diff.counterexample.c_str(), diff.tagA >= 0 ? tokenKindName(diff.tagA) : "no token",
+                diff.tagB >= 0 ? tokenKindName(diff.tagB) : "no token",
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+    if (diff.equal) return 1;
+
+    // provenance (provenance.h): the NFA-set vectors construction leaves
+    // behind vs the same sets packed into arenas, against the table itself
+    for (const DFA *d : { &lexer, &minKeywords, &bigSubset }) {
+        DFA packed = *d;
+        auto p0 = std::chrono::steady_clock::now();
+        setProvenance(packed, PROVENANCE_PACKED);
+        double packMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - p0).count();
+        NFASet a, b;
+        p0 = std::chrono::steady_clock::now();
+        for (int s = 0; s < d->numStates; ++s) {
+            if (dfaStateSet(packed, s, a) != dfaStateSet(*d, s, b) || a != b) { std::printf("packed set differs\n"); return 1; }
+        }
+        double getMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - p0).count();
+        size_t tableBytes = d->table.size() * 4 + d->table16.size() * 2;
+        std::printf("provenance, %d states: table %zu KB, full %zu KB, packed %zu KB (pack %.2f ms, decode all %.2f ms)\n",
+                    d->numStates, tableBytes >> 10, provenanceBytes(*d) >> 10, provenanceBytes(packed) >> 10, packMs, getMs);
+    }
+
+    // a spec with unbounded lookahead, a | a*b, on a run of a's: restarting
+    // after every one-byte token rescans the rest of the run (quadratic)
+    // unless failed (state, position) pairs are memoized
+    NFA rescanNfa;
+    rescanNfa.start = rescanNfa.newState();
+    Fragment single = makeChar(rescanNfa, 'a');
+    Fragment longer = concatFrag(rescanNfa, starFrag(rescanNfa, makeChar(rescanNfa, 'a')), makeChar(rescanNfa, 'b'));
+    for (Fragment f : { single, longer }) {
+        rescanNfa.addEps(rescanNfa.start, f.start);
+        rescanNfa.accepts.insert(f.accept);
+    }
+    DFA rescan = subsetConstruction(rescanNfa);
+    DFAView plainView = rescan.view();
+    plainView.lookahead = 0; // pretend the lookahead is bounded: plain maximal munch
+    std::printf("a | a*b: lookahead %d\n", rescan.lookahead);
+    for (int n : { 10000, 20000, 40000 }) {
+        std::string run(n, 'a');
+        std::vector<TokenItem> tokP, tokM;
+        double p = tokenizeAll([&] { return tokenizeWithDFA(run, plainView); }, &tokP);
+        double m = tokenizeAll([&] { return tokenizeWithDFA(run, rescan.view()); }, &tokM);
+        std::printf("  %6d bytes: plain %8.2f ms, memoized %6.2f ms\n", n, p * 1e3, m * 1e3);
+        if (!sameTokens(tokP, tokM)) return 1;
+    }
+    // on the tagged lexer, so the memo's captures are checked as well
+    DFAView untagged = view;
+    untagged.numTags = 0;
+    for (int r = 0; r < rounds; ++r) {
+        std::vector<TokenItem> tokP, tokM;
+        double p = tokenizeAll([&] { return tokenizeWithDFA(in, view); }, &tokP);
+        double m = tokenizeAll([&] { return tokenizeMemoized(in, view); }, &tokM);
+        report("lexer/plain", p, in.size(), tokP.size());
+        report("lexer/memoized", m, in.size(), tokM.size());
+        if (!sameTokens(tokP, tokM)) return 1;
+    }
+
+    // Number captures: recorded by the tagged lexer during its scan, vs the
+    // untagged scan followed by a pass that splits every Number's text again
+    std::string numbers = makeWords(mb << 20, true, 12);
+    for (int r = 0; r < rounds; ++r) {
+        std::vector<TokenItem> tokT, tokR;
+        double t = tokenizeAll([&] { return tokenizeWithDFA(numbers, view); }, &tokT);
+        double p = tokenizeAll([&] {
+            std::vector<TokenItem> out = tokenizeWithDFA(numbers, untagged);
+            for (TokenItem &tok : out) {
+                if (tok.type != tokenKindName(TOK_NUMBER)) continue;
+                size_t dot = tok.text.find('.');
+                tok.captures.resize(NUMBER_CAPTURE_COUNT);
+                tok.captures[NUMBER_INT] = { 0, (int)std::min(dot, tok.text.size()) };
+                if (dot != std::string::npos) tok.captures[NUMBER_FRAC] = { (int)dot + 1, (int)(tok.text.size() - dot - 1) };
+            }
+            return out;
+        }, &tokR);
+        report("captures/tagged", t, numbers.size(), tokT.size());
+        report("captures/rescan", p, numbers.size(), tokR.size());
+        if (!sameTokens(tokT, tokR)) return 1;
+        // every engine on a compiled lexer keeps the captures: the memo, on
+        // its own and where unbounded lookahead (pretended here) forces it
+        DFAView unbounded = view;
+        unbounded.lookahead = -1;
+        std::vector<TokenItem> tokM, tokU, tokUP;
+        double m = tokenizeAll([&] { return tokenizeWithEngine(numbers, view, ENGINE_MEMO); }, &tokM);
+        double u = tokenizeAll([&] { return tokenizeWithDFA(numbers, unbounded); }, &tokU);
+        double up = tokenizeAll([&] { return tokenizeParallel(numbers, unbounded, 4); }, &tokUP);
+        report("captures/memoized", m, numbers.size(), tokM.size());
+        report("captures/unbounded", u, numbers.size(), tokU.size());
+        report("captures/unbounded/par", up, numbers.size(), tokUP.size());
+        if (!sameTokens(tokT, tokM) || !sameTokens(tokT, tokU) || !sameTokens(tokT, tokUP)) return 1;
+    }
+    // batch matching reports the same captures on either engine, including
+    // the shuffle engine a small tagged DFA gets from packDFA
+    {
+        DFA numberDfa = compileLexerDFA(buildNumberNFA_thompson());
+        DFAView table = numberDfa.view();
+        table.sheng = nullptr;
+        const std::string samples[] = { "12.5", "7", "0.25x", "3.", "x1" };
+        for (const DFAView &v : { numberDfa.view(), table }) {
+            for (const std::string &s : samples) {
+                int want[MAX_TAGS], got[MAX_TAGS], wantTag = -1;
+                int wantLen = dfaLongestMatchCaptures(v, s, 0, &wantTag, want);
+                MatchStream m;
+                m.input = &s;
+                m.tagPos = got;
+                dfaLongestMatchBatch(v, &m, 1);
+                if (m.len != wantLen || m.tag != wantTag || !std::equal(want, want + v.numTags, got)) {
+                    std::printf("batch captures differ on \"%s\"\n", s.c_str());
+                    return 1;
+                }
+            }
+        }
+        std::printf("batch captures: number DFA, %d tags, default engine: %s\n", numberDfa.numTags,
+                    numberDfa.sheng.empty() ? "table" : "shuffle");
+    }
+
+    // both engines on the small built-in DFAs, whichever one packDFA picked,
+    // and the matcher specialized on the compile-time table (static_dfa.h)
+    std::printf("shuffle engine %s\n", shengSupported() ? "available" : "not supported by this CPU");
+    const DFA small[2] = { staticToDFA(identifierTable), staticToDFA(numberTable) };
+    for (int which = 0; which < 2; ++which) {
+        // the compile-time pipeline must still build what nfa.cpp specifies
+        DFA runtime = minimizeDFA(subsetConstruction(which ? buildNumberNFA_thompson() : buildIdentifierNFA_thompson()));
+        DFAEquivalence same = dfaEquivalent(small[which].view(), runtime.view());
+        if (!same.equal || small[which].numStates != runtime.numStates) {
+            std::printf("compile-time %s DFA differs from the runtime one on \"%s\"\n",
+                        which ? "number" : "identifier", same.counterexample.c_str());
+            return 1;
+        }
+    }
+    for (int which = 0; which < 2; ++which) {
+        std::vector<uint8_t> shuffle;
+        buildShengTable(small[which].view(), shuffle);
+        DFAView table = small[which].view(), sheng = table;
+        table.sheng = nullptr;
+        sheng.sheng = shuffle.data();
+        std::printf("%s DFA, %d states, default engine: %s\n", which ? "number" : "identifier",
+                    small[which].numStates, small[which].sheng.empty() ? "table" : "shuffle");
+        for (int maxLen : { 8, 24, 64 }) {
+            std::string words = makeWords(mb << 20, which == 1, maxLen);
+            MatchTally matchT, matchS, matchC;
+            double t = matchOnly(words, [&table](const std::string &s, int pos, int *tag) {
+                return dfaLongestMatchTagged(table, s, pos, tag);
+            }, &matchT);
+            // a static table has one token kind, tag 0 (see staticToDFA)
+            double st = which ? matchOnly(words, [](const std::string &s, int pos, int *tag) {
+                *tag = 0;
+                return staticLongestMatch<numberTable>(s, pos);
+            }, &matchC) : matchOnly(words, [](const std::string &s, int pos, int *tag) {
+                *tag = 0;
+                return staticLongestMatch<identifierTable>(s, pos);
+            }, &matchC);
+            std::printf("  words up to %2d bytes:\n", maxLen);
+            report("    table", t, words.size(), matchT.tokens);
+            report("    static", st, words.size(), matchC.tokens);
+            if (matchC != matchT) { std::printf("matches differ\n"); return 1; }
+            if (!shengSupported()) continue;
+            double sh = matchOnly(words, [&sheng](const std::string &s, int pos, int *tag) {
+                return dfaLongestMatchTagged(sheng, s, pos, tag);
+            }, &matchS);
+            report("    shuffle", sh, words.size(), matchS.tokens);
+            if (matchT != matchS) { std::printf("matches differ\n"); return 1; }
+        }
+    }
+
+    // bounded repetition (repeatFrag): identifiers [A-Za-z_][A-Za-z0-9_]{0,63}
+    // and numbers [0-9]{1,20} with counted loops vs expanded into copies
+    NFA counted;
+    counted.start = counted.newState();
+    std::vector<char> idFirst, idRest, digits;
+    pushRange(idFirst, 'a', 'z');
+    pushRange(idFirst, 'A', 'Z');
+    idFirst.push_back('_');
+    idRest = idFirst;
+    pushRange(idRest, '0', '9');
+    pushRange(digits, '0', '9');
+    Fragment idFrag = concatFrag(counted, makeCharClass(counted, idFirst), repeatFrag(counted, idRest, 0, 63));
+    Fragment numFrag = repeatFrag(counted, digits, 1, 20);
+    for (Fragment f : { idFrag, numFrag }) {
+        counted.addEps(counted.start, f.start);
+        counted.accepts.insert(f.accept);
+        counted.acceptTag[f.accept] = f.start == idFrag.start ? TOK_IDENTIFIER : TOK_NUMBER;
+    }
+    NFA expanded = expandCounters(counted);
+    DFA countedDfa = minimizeDFA(subsetConstruction(counted));
+    packDFA(countedDfa);
+    std::string countedText = makeWords(mb << 19, false, 80) + makeWords(mb << 19, true, 30);
+    std::printf("{0,63} / {1,20} spec: %zu NFA states counted, %zu expanded, %d DFA states\n",
+                counted.states.size(), expanded.states.size(), countedDfa.numStates);
+    for (int r = 0; r < rounds; ++r) {
+        std::vector<TokenItem> tokT, tokLC, tokLE, tokNC, tokNE;
+        double t = tokenizeAll([&] { return tokenizeWithDFA(countedText, countedDfa.view()); }, &tokT);
+        double lc = tokenizeAll([&] { LazyDFA l(counted); return tokenizeWithDFA(countedText, l); }, &tokLC);
+        double le = tokenizeAll([&] { LazyDFA l(expanded); return tokenizeWithDFA(countedText, l); }, &tokLE);
+        double nc = tokenizeAll([&] { NFASimulator s(counted); return tokenizeWithNFA(countedText, s); }, &tokNC);
+        double ne = tokenizeAll([&] { NFASimulator s(expanded); return tokenizeWithNFA(countedText, s); }, &tokNE);
+        report("  repeat/table", t, countedText.size(), tokT.size());
+        report("  repeat/lazy/counted", lc, countedText.size(), tokLC.size());
+        report("  repeat/lazy/copies", le, countedText.size(), tokLE.size());
+        report("  repeat/nfa/counted", nc, countedText.size(), tokNC.size());
+        report("  repeat/nfa/copies", ne, countedText.size(), tokNE.size());
+        if (!sameTokens(tokT, tokLC) || !sameTokens(tokT, tokLE) || !sameTokens(tokT, tokNC) || !sameTokens(tokT, tokNE))
+            return 1;
+    }
+
+    // planner: each engine it considers timed on every corpus, set-up included
+    NFA plainSpec = buildLexerNFA_thompson();
+    plainSpec.tagOf.clear(); // the lazy DFA and NFA simulator record no captures
+    // fitted on the training corpus, not on the corpora checked below
+    LexCosts costs = calibrateLexCosts(view, plainSpec, lexerTrainingCorpus());
+    setLexCosts(costs);
+    std::printf("calibrated ns: loop %.1f + %.1f per doubling, shuffle step %.2f, tag %.2f, memo %.2f + %.1f per record,\n"
+                "  lazy step %.1f, nfa %.1f per state, compile %.0f per state\n",
+                costs.loop, costs.loopGrowth, costs.shengStep, costs.tag, costs.memo, costs.memoRecord,
+                costs.lazyStep, costs.nfaState, costs.compile);
+    std::vector<uint8_t> shuffles[2];
+    DFAView smallViews[2];
+    for (int which = 0; which < 2; ++which) {
+        buildShengTable(small[which].view(), shuffles[which]);
+        smallViews[which] = small[which].view();
+        if (shengSupported()) smallViews[which].sheng = shuffles[which].data();
+    }
+    // (a|b)*a(a|b){14}: the DFA needs a state per window of the last 15 letters
+    NFA blowup;
+    blowup.start = blowup.newState();
+    Fragment ab = altFrag(blowup, makeChar(blowup, 'a'), makeChar(blowup, 'b'));
+    Fragment tail = concatFrag(blowup, starFrag(blowup, ab), makeChar(blowup, 'a'));
+    for (int k = 0; k < 14; ++k)
+        tail = concatFrag(blowup, tail, altFrag(blowup, makeChar(blowup, 'a'), makeChar(blowup, 'b')));
+    blowup.addEps(blowup.start, tail.start);
+    blowup.accepts.insert(tail.accept);
+    std::string abText;
+    for (unsigned seed = 5; abText.size() < (mb << 20) / 4;) {
+        seed = seed * 1103515245 + 12345;
+        abText += (seed >> 16) % 61 ? "ab"[(seed >> 20) & 1] : ' ';
+    }
+    LazyDFA probe(blowup);
+    tokenizeWithDFA(abText.substr(0, 1 << 16), probe);
+    // the same language with [ab]{14} as one counted loop: the NFA simulator
+    // tracks a word of counts instead of 14 copies
+    NFA countedBlowup;
+    countedBlowup.start = countedBlowup.newState();
+    Fragment countedTail = concatFrag(countedBlowup,
+        starFrag(countedBlowup, altFrag(countedBlowup, makeChar(countedBlowup, 'a'), makeChar(countedBlowup, 'b'))),
+        makeChar(countedBlowup, 'a'));
+    countedTail = concatFrag(countedBlowup, countedTail, repeatFrag(countedBlowup, { 'a', 'b' }, 14, 14));
+    countedBlowup.addEps(countedBlowup.start, countedTail.start);
+    countedBlowup.accepts.insert(countedTail.accept);
+    for (int r = 0; r < rounds; ++r) {
+        std::vector<TokenItem> tokC, tokE;
+        double c = tokenizeAll([&] { NFASimulator s(countedBlowup); return tokenizeWithNFA(abText, s); }, &tokC);
+        double e = tokenizeAll([&] { NFASimulator s(blowup); return tokenizeWithNFA(abText, s); }, &tokE);
+        report("(a|b)*a[ab]{14}/counted", c, abText.size(), tokC.size());
+        report("(a|b)*a(a|b){14}/nfa", e, abText.size(), tokE.size());
+        if (!sameTokens(tokC, tokE)) return 1;
+    }
+    std::string run(40000, 'a');
+    DFAView rescanView = rescan.view();
+
+    std::vector<PlanCase> cases;
+    cases.push_back({ "lexer", nullptr, &view, in });
+    cases.push_back({ "lexer, no captures", &plainSpec, &untagged, in });
+    cases.push_back({ "lexer spec, one block", &plainSpec, nullptr, blocks[0] });
+    cases.push_back({ "lexer spec, whole input", &plainSpec, nullptr, in });
+    cases.push_back({ "identifier DFA", nullptr, &smallViews[0], makeWords(mb << 20, false, 8) });
+    cases.push_back({ "number DFA", nullptr, &smallViews[1], makeWords(mb << 20, true, 8) });
+    cases.push_back({ "a | a*b", &rescanNfa, &rescanView, run });
+    cases.push_back({ "(a|b)*a(a|b){14}", &blowup, nullptr, abText, (double)probe.stats().misses / (1 << 16),
+                      (double)probe.stats().setSizes / std::max<uint64_t>(1, probe.stats().misses) });
+    int good = 0;
+    for (const PlanCase &c : cases) {
+        bool ok = false;
+        if (!checkPlan(c, rounds, &ok)) return 1;
+        good += ok;
+    }
+    std::printf("planner: %d of %zu picks within the run-to-run noise of the fastest engine\n", good, cases.size());
+    return good == (int)cases.size() ? 0 : 1;
+}
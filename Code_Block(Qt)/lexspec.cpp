@@ -0,0 +1,122 @@
+#include "lexspec.h"
+#include "minimize.h"
+#include "parallel_subset.h"
+#include "incremental_subset.h"
+#include "tagdfa.h"
+#include "utf8.h"
+
+static const char *keywords[] = {
+    "int","float","if","else","while","for","break","continue","return"
+};
+static const char operators[] = {
+    '+','-','*','/','=','<','>','!','&','|','%'
+};
+static const char delimiters[] = {
+    '(',')','{','}','[',']',',',';',':'
+};
+
+const char *tokenKindName(int kind) {
+    switch (kind) {
+    case TOK_KEYWORD: return "Keyword";
+    case TOK_IDENTIFIER: return "Identifier";
+    case TOK_NUMBER: return "Number";
+    case TOK_OPERATOR: return "Operator";
+    case TOK_DELIMITER: return "Delimiter";
+    default: return "Unknown";
+    }
+}
+
+// Hang a sub-NFA off the union start, tagging every accept it has
+int addLexerAlternative(NFA &lexer, const NFA &sub, int tag) {
+    int off = appendNFA(lexer, sub);
+    lexer.addEps(lexer.start, sub.start + off);
+    for (int a : sub.accepts) {
+        lexer.accepts.insert(a + off);
+        lexer.acceptTag[a + off] = tag;
+    }
+    return sub.start + off;
+}
+
+// Alternative for a literal word, e.g. a keyword
+int addLexerLiteral(NFA &lexer, const std::string &word, int tag) {
+    Fragment f = makeChar(lexer, word[0]);
+    for (size_t i = 1; i < word.size(); ++i) f = concatFrag(lexer, f, makeChar(lexer, word[i]));
+    lexer.addEps(lexer.start, f.start);
+    lexer.accepts.insert(f.accept);
+    lexer.acceptTag[f.accept] = tag;
+    return f.start;
+}
+
+// Alternative for a single character out of a set
+int addLexerCharSet(NFA &lexer, const std::vector<char> &chars, int tag) {
+    Fragment f = makeCharClass(lexer, chars);
+    lexer.addEps(lexer.start, f.start);
+    lexer.accepts.insert(f.accept);
+    lexer.acceptTag[f.accept] = tag;
+    return f.start;
+}
+
+// The states stay, unreachable, so later ids do not move
+void removeLexerAlternative(NFA &lexer, int altStart) {
+    lexer.states[lexer.start].eps.erase(altStart);
+}
+
+// Union of all token NFAs, each accept tagged with its TokenKind
+NFA buildLexerNFA_thompson() {
+    NFA lexer;
+    lexer.start = lexer.newState();
+    for (const char *kw : keywords) addLexerLiteral(lexer, kw, TOK_KEYWORD);
+    addLexerAlternative(lexer, buildXIDIdentifierNFA_thompson(), TOK_IDENTIFIER);
+    addLexerAlternative(lexer, buildNumberNFA_thompson(), TOK_NUMBER);
+    addLexerCharSet(lexer, std::vector<char>(std::begin(operators), std::end(operators)), TOK_OPERATOR);
+    addLexerCharSet(lexer, std::vector<char>(std::begin(delimiters), std::end(delimiters)), TOK_DELIMITER);
+    return lexer;
+}
+
+// Determinized and minimized combined lexer
+DFA buildLexerDFA() {
+    return compileLexerDFA(buildLexerNFA_thompson());
+}
+
+// Tags are derived from the NFA sets, so before minimization merges them;
+// a spec whose tags do not fit the tagged DFA still lexes, without captures
+DFA compileLexerDFA(const NFA &lexNfa) {
+    DFA d = subsetConstructionParallel(lexNfa);
+    computeTags(lexNfa, d);
+    return minimizeDFA(d);
+}
+
+// Same, determinizing incrementally from the previous build when there is one
+DFA recompileLexerDFA(LexerBuild &build, const NFA &lexNfa) {
+    if (build.subset.numStates > 0) build.subset = subsetConstructionIncremental(build.subset, build.nfa, lexNfa);
+    else build.subset = subsetConstructionParallel(lexNfa);
+    build.nfa = lexNfa;
+    computeTags(lexNfa, build.subset);
+    return minimizeDFA(build.subset);
+}
+
+// Code of the kind the app validates, covering every token kind
+std::vector<std::string> lexerTrainingCorpus() {
+    return {
+        "int main() {\n"
+        "    int count = 0;\n"
+        "    float ratio = 0.75;\n"
+        "    for (int i = 0; i < 100; i = i + 1) {\n"
+        "        if (i % 2 == 0 && count != 10) { count = count + 1; }\n"
+        "        else { ratio = ratio * 1.5 - i; }\n"
+        "    }\n"
+        "    while (count >= 3) { count = count / 2; continue; }\n"
+        "    return count;\n"
+        "}\n",
+        "float average(int values[], int size) {\n"
+        "    float sum = 0.0;\n"
+        "    for (int k = 0; k < size; k = k + 1) sum = sum + values[k];\n"
+        "    if (size > 0) return sum / size;\n"
+        "    return 0;\n"
+        "}\n",
+        "int max_value = 255; int min_value = 0;\n"
+        "if (max_value > min_value || flag) { result = max_value - min_value; }\n"
+        "while (!done) { step = step + 1; if (step > 1000) break; }\n"
+        "float größe = 1.25; int _tmp2 = 42;\n",
+    };
+}
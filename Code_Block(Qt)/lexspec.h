@@ -0,0 +1,59 @@
+#ifndef LEXSPEC_H
+#define LEXSPEC_H
+
+#include "dfa.h"
+#include <string>
+#include <vector>
+
+// Token kinds double as accept tags of the combined lexer: a lower value wins
+// when several token NFAs accept the same longest match (keywords beat
+// identifiers, identifiers beat numbers).
+enum TokenKind {
+    TOK_KEYWORD = 0,
+    TOK_IDENTIFIER,
+    TOK_NUMBER,
+    TOK_OPERATOR,
+    TOK_DELIMITER,
+    TOK_KIND_COUNT
+};
+
+// Display name used in TokenItem::type ("Keyword", "Identifier", ...)
+const char *tokenKindName(int kind);
+
+// Union of all token NFAs, each accept tagged with its TokenKind
+NFA buildLexerNFA_thompson();
+
+// Edit a union NFA (e.g. in a spec editor): each add hangs a new alternative
+// off lexer.start, with every accept tagged tag, and returns the id of its
+// first state; remove unlinks one again. New states always go at the end and
+// removed ones stay, so existing NFA ids never move and the lexer can be
+// recompiled incrementally (recompileLexerDFA).
+int addLexerAlternative(NFA &lexer, const NFA &sub, int tag);
+int addLexerLiteral(NFA &lexer, const std::string &word, int tag);
+int addLexerCharSet(NFA &lexer, const std::vector<char> &chars, int tag);
+void removeLexerAlternative(NFA &lexer, int altStart);
+
+// Determinized and minimized combined lexer, with its position tags (the
+// captures of Number tokens, see tagdfa.h)
+DFA buildLexerDFA();
+
+// Same, from a lexer NFA already built (e.g. to hash it first)
+DFA compileLexerDFA(const NFA &lexNfa);
+
+// The union NFA and its subset DFA (before tags and minimization) of the
+// last recompileLexerDFA, which the next one starts from
+struct LexerBuild {
+    NFA nfa;
+    DFA subset;
+};
+
+// compileLexerDFA with incremental determinization: only the DFA states
+// whose NFA sets touch what changed since build are expanded again
+// (subsetConstructionIncremental); the first call builds from scratch.
+// build is updated to lexNfa.
+DFA recompileLexerDFA(LexerBuild &build, const NFA &lexNfa);
+
+// Sample source the lexer's state layout is profiled on (applyProfileLayout)
+std::vector<std::string> lexerTrainingCorpus();
+
+#endif // LEXSPEC_H
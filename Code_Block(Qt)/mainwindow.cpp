@@ -1,10 +1,27 @@
 #include "mainwindow.h"
+#include "static_dfa.h"
+#include "equiv.h"
 #include <QApplication>
 #include <QMessageBox>
 #include <QPainterPath>
 #include <QTableWidgetItem>
 #include <QHeaderView>
 #include <QFontMetrics>
+#include <QStandardPaths>
+#include <QDir>
+#include <QFile>
+#ifdef CODEBLOCK_DIRECT_SCANNER
+#include "direct_scanner.h"
+#endif
+
+// Provenance the finished DFAs keep for the visualizer (CODEBLOCK_PROVENANCE)
+#if defined(CODEBLOCK_PROVENANCE_NONE)
+static const ProvenanceMode appProvenance = PROVENANCE_NONE;
+#elif defined(CODEBLOCK_PROVENANCE_FULL)
+static const ProvenanceMode appProvenance = PROVENANCE_FULL;
+#else
+static const ProvenanceMode appProvenance = PROVENANCE_PACKED;
+#endif
 
 // --- AutomatonVisualizer Implementation ---
 
@@ -30,7 +47,7 @@ double AutomatonVisualizer::getScale() const {
 }
 
 void AutomatonVisualizer::computeNodePositionsAuto(const DFA &d, const QRectF &rc, QVector<QPointF>& pts, double scale) {
-    int n = (int)d.rev.size();
+    int n = d.numStates;
     pts.resize(n);
     if (n == 0) return;
 
@@ -80,7 +97,7 @@ QString AutomatonVisualizer::charsToLabel(const QSet<char>& s) const {
 }
 
 void AutomatonVisualizer::drawDFAVisual(QPainter &painter, const DFA &d, const QRectF &rc, QVector<QPointF> &posStore) {
-    int n = (int)d.rev.size();
+    int n = d.numStates;
     if (n == 0) {
         painter.drawText(QRectF(8, 8, width(), 20), "(No states)");
         return;
@@ -96,8 +113,9 @@ void AutomatonVisualizer::drawDFAVisual(QPainter &painter, const DFA &d, const Q
     // Aggregate labels
     QMap<QPair<int, int>, QSet<char>> emap;
     for (int i = 0; i < n; ++i) {
-        for (const auto &kv : d.trans[i]) {
-            emap[{i, kv.second}].insert(kv.first);
+        for (int c = 0; c < 256; ++c) {
+            int to = d.next(i, (unsigned char)c);
+            if (to != DFA_DEAD) emap[{i, to}].insert((char)c);
         }
     }
 
@@ -163,7 +181,7 @@ void AutomatonVisualizer::drawDFAVisual(QPainter &painter, const DFA &d, const Q
             painter.fillRect(QRectF(p.x() - r - 4, p.y() - r - 4, 2*(r+4), 2*(r+4)), QColor(220, 235, 255));
         }
         painter.drawEllipse(p, r, r);
-        if (d.accepts.count(i)) {
+        if (d.isAccept(i)) {
             painter.save();
             QPen pen(QColor(34,139,34), 2);
             painter.setPen(pen);
@@ -293,21 +311,39 @@ void AutomatonVisualizer::mousePressEvent(QMouseEvent *event) {
         info = "(no state selected)";
     } else {
         info = QString("State: %1\n").arg(found);
-        if (found < m_dfa->rev.size()) {
+        // provenance may be packed or dropped (setProvenance), so go through the accessors
+        NFASet set, origin;
+        if (dfaStateSet(*m_dfa, found, set)) {
             info += "NFA set: { ";
             bool first = true;
-            for (int x : m_dfa->rev[found]) {
+            for (int x : set) {
                 if (!first) info += ", ";
                 first = false;
                 info += QString::number(x);
             }
             info += " }\n";
         }
+        if (dfaStateOrigin(*m_dfa, found, origin) && origin.size() > 1) {
+            info += "Merged from:\n";
+            for (int q : origin) {
+                info += QString("  D%1 { ").arg(q);
+                bool first = true;
+                if (dfaOriginSet(*m_dfa, q, set)) {
+                    for (int x : set) {
+                        if (!first) info += ", ";
+                        first = false;
+                        info += QString::number(x);
+                    }
+                }
+                info += " }\n";
+            }
+        }
         info += "Outgoing:\n";
         QMap<int, QSet<char>> out;
-        if (found < m_dfa->trans.size()) {
-            for (const auto &kv : m_dfa->trans[found]) {
-                out[kv.second].insert(kv.first);
+        if (found < m_dfa->numStates) {
+            for (int c = 0; c < 256; ++c) {
+                int to = m_dfa->next(found, (unsigned char)c);
+                if (to != DFA_DEAD) out[to].insert((char)c);
             }
         }
         for (const auto &kv : out.toStdMap()) {
@@ -395,11 +431,7 @@ MainWindow::MainWindow(QWidget *parent)
     setupUI();
 
     // Build initial DFAs
-    NFA nid = buildIdentifierNFA_thompson();
-    NFA nnum = buildNumberNFA_thompson();
-    m_dfaId = subsetConstruction(nid);
-    m_dfaNum = subsetConstruction(nnum);
-    m_haveDfas = true;
+    buildDfas();
 
     // Set the DFA for the visualizer to show the Identifier DFA by default
     m_visualizer->setDFA(&m_dfaId);
@@ -490,17 +522,74 @@ void MainWindow::setupUI() {
 }
 
 void MainWindow::onAnalyzeClicked() {
-    // Rebuild DFAs (keeps logic in sync)
-    NFA nid = buildIdentifierNFA_thompson();
-    NFA nnum = buildNumberNFA_thompson();
-    m_dfaId = subsetConstruction(nid);
-    m_dfaNum = subsetConstruction(nnum);
-    m_haveDfas = true;
-
+    // m_lexer stays as built; only an edit of the token spec rebuilds it
     analyzeCode();
     m_visualizer->update();
 }
 
+void MainWindow::buildDfas() {
+    // identifier and number tables are built by the compiler (static_dfa.h)
+    m_dfaId = staticToDFA(identifierTable);
+    m_dfaNum = staticToDFA(numberTable);
+    setProvenance(m_dfaId, appProvenance);
+    setProvenance(m_dfaNum, appProvenance);
+    loadOrBuildLexer(buildLexerNFA_thompson());
+#ifdef CODEBLOCK_DIRECT_SCANNER
+    if (m_lexerSpecHash != directScannerSpecHash)
+        qWarning() << "Direct scanner was generated from another token spec, tokenizing with the lexer table";
+#endif
+    m_haveDfas = true;
+}
+
+// Called at startup and after each edit of the token spec lexNfa (not per
+// analysis). Keep the lexer when the spec is unchanged; otherwise reuse the
+// compiled lexer from the cache directory when it matches the spec, or
+// determinize it (incrementally from the previous build) and refresh the cache.
+// A rebuilt table is only used once it is proven equivalent to the subset DFA
+// it was minimized from and, when that subset DFA reused rows of the previous
+// build, the subset DFA to the spec determinized from scratch.
+void MainWindow::loadOrBuildLexer(const NFA &lexNfa) {
+    uint64_t specHash = hashNFASpec(lexNfa);
+    if (m_lexer.numStates > 0 && specHash == m_lexerSpecHash) return;
+    m_lexPlans.clear();
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    std::string cachePath = QFile::encodeName(cacheDir + "/lexer.dfa").toStdString();
+    std::string err;
+    if (loadDFA(cachePath, specHash, m_lexer, &err)) {
+        m_lexerSpecHash = specHash;
+        setProvenance(m_lexer, appProvenance);
+        return;
+    }
+    m_lexer = recompileLexerDFA(m_lexerBuild, lexNfa);
+    m_lexerSpecHash = specHash;
+    // hot-first rows only pay once the table outgrows the cache
+    if (profileLayoutPays(m_lexer)) applyProfileLayout(m_lexer, lexerTrainingCorpus());
+    // incremental determinization is checked against a build from scratch; it
+    // costs what the incremental build saved, but only when the spec changed
+    DFAEquivalence check = dfaEquivalent(m_lexer.view(), m_lexerBuild.subset.view());
+    if (check.equal && m_lexerBuild.subset.stats.statesReused > 0)
+        check = dfaEquivalent(m_lexerBuild.subset.view(), subsetConstruction(lexNfa).view());
+    if (!check.equal) {
+        qWarning() << "Rebuilt lexer differs from its reference DFA on" << QString::fromStdString(check.counterexample)
+                   << "(tags" << check.tagA << "vs" << check.tagB << "), building it from scratch";
+        m_lexerBuild = LexerBuild();
+        m_lexer = recompileLexerDFA(m_lexerBuild, lexNfa);
+        if (profileLayoutPays(m_lexer)) applyProfileLayout(m_lexer, lexerTrainingCorpus());
+        check = dfaEquivalent(m_lexer.view(), m_lexerBuild.subset.view());
+        if (!check.equal) {
+            // minimization is at fault; the subset DFA itself is the proven table
+            qWarning() << "Minimized lexer differs from its subset DFA on" << QString::fromStdString(check.counterexample)
+                       << "(tags" << check.tagA << "vs" << check.tagB << "), using the subset DFA";
+            m_lexer = m_lexerBuild.subset;
+        }
+    }
+    QDir().mkpath(cacheDir);
+    if (!saveDFA(m_lexer, cachePath, specHash, true, &err))
+        qWarning() << "Lexer cache not written:" << QString::fromStdString(err);
+    // m_lexerBuild keeps the full sets the next incremental rebuild needs
+    setProvenance(m_lexer, appProvenance);
+}
+
 void MainWindow::onShowIdClicked() {
     m_visualChoice = 1;
     m_visualizer->setDFA(&m_dfaId);
@@ -539,7 +628,13 @@ void MainWindow::analyzeCode() {
         return;
     }
 
-    auto tokens = tokenizeWithDFA(code, m_dfaId, m_dfaNum);
+#ifdef CODEBLOCK_DIRECT_SCANNER
+    // the generated scanner only lexes the spec it was generated from
+    auto tokens = m_lexerSpecHash == directScannerSpecHash ? tokenizeDirect(code)
+                                                           : tokenizeWithDFA(code, m_lexer.view(), &m_lexPlans);
+#else
+    auto tokens = tokenizeWithDFA(code, m_lexer.view(), &m_lexPlans);
+#endif
 
     // Clear the existing table
     m_tokensTable->setRowCount(0);
@@ -561,18 +656,21 @@ void MainWindow::analyzeCode() {
         const auto& firstToken = tokens[0];
         QString qTokenText = QString::fromStdString(firstToken.text);
 
-        // Trace the path for the entire input string (starting at position 0)
-        auto [len, path] = dfaLongestMatchWithTrace(m_dfaId, code, 0);
-        if (!path.isEmpty()) {
-            m_visualizer->setTracePath(path, qTokenText);
+        // Pick the DFA by the kind the lexer gave a token at position 0
+        // (keywords are spelled like identifiers). The identifier DFA shown
+        // is the ASCII one, so a non-ASCII identifier is traced as far as
+        // that DFA reads it.
+        const DFA *traced = nullptr;
+        if (firstToken.line == 1 && firstToken.col == 1) {
+            if (firstToken.type == tokenKindName(TOK_IDENTIFIER) || firstToken.type == tokenKindName(TOK_KEYWORD))
+                traced = &m_dfaId;
+            else if (firstToken.type == tokenKindName(TOK_NUMBER))
+                traced = &m_dfaNum;
+        }
+        if (traced && dfaLongestMatchWithTrace(*traced, code, 0, m_traceBuffer) > 0) {
+            m_visualizer->setTracePath(QVector<int>(m_traceBuffer.begin(), m_traceBuffer.end()), qTokenText);
         } else {
-            // If the Identifier DFA doesn't match, try the Number DFA
-            auto [lenNum, pathNum] = dfaLongestMatchWithTrace(m_dfaNum, code, 0);
-            if (!pathNum.isEmpty()) {
-                m_visualizer->setTracePath(pathNum, qTokenText);
-            } else {
-                m_visualizer->resetTrace();
-            }
+            m_visualizer->resetTrace();
         }
     } else {
         m_visualizer->resetTrace();
@@ -25,6 +25,9 @@
 #include <algorithm>
 #include <cmath>
 #include "dfa.h"
+#include "minimize.h"
+#include "profile.h"
+#include "dfaio.h"
 #include "tokenizer.h"
 #include "pda.h"
 
@@ -92,6 +95,8 @@ private slots:
 
 private:
     void setupUI();
+    void buildDfas();
+    void loadOrBuildLexer(const NFA &lexNfa);
     void analyzeCode();
     void showTokenTable();
 
@@ -103,6 +108,11 @@ private:
 
     DFA m_dfaId;
     DFA m_dfaNum;
+    DFA m_lexer; // combined DFA used for tokenization
+    LexerBuild m_lexerBuild; // what the next spec change is determinized from
+    uint64_t m_lexerSpecHash = 0; // hashNFASpec of the spec m_lexer was built from
+    std::vector<int> m_traceBuffer; // state path buffer reused by dfaLongestMatchWithTrace
+    LexPlanCache m_lexPlans; // engine plans for m_lexer by input size (planner.h)
     bool m_haveDfas = false;
     int m_visualChoice = 0; // 0 none, 1 id, 2 num
 };
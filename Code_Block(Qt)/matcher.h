@@ -0,0 +1,330 @@
+#ifndef MATCHER_H
+#define MATCHER_H
+
+#include "dfa.h"
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Longest-match core shared by every table-driven matcher. What gets recorded
+// along the way is a sink policy, so the plain match instantiates to the bare
+// scan loop and tracing or counting pay only for what they record.
+//
+// A sink provides
+//   static const bool observes;     // false: nothing is recorded, any engine may run
+//   void state(int s);              // a state entered on one byte
+//   void run(int s, int count);     // count self-loop bytes of s skipped at once
+
+// Records nothing
+struct NoSink {
+    static const bool observes = false;
+    void state(int) {}
+    void run(int, int) {}
+};
+
+// Appends the states entered to a caller vector, so it only grows as far as
+// the match actually goes
+struct PathSink {
+    static const bool observes = true;
+    std::vector<int> &out;
+    explicit PathSink(std::vector<int> &path) : out(path) {}
+    void state(int s) { out.push_back(s); }
+    void run(int s, int n) { out.insert(out.end(), (size_t)n, s); }
+};
+
+// Counts transitions taken (bytes consumed by the automaton)
+struct CountSink {
+    static const bool observes = true;
+    uint64_t steps = 0;
+    void state(int) { ++steps; }
+    void run(int, int n) { steps += (uint64_t)n; }
+};
+
+// Scan loop over either table width. Stores the state of the last accept in
+// *acceptState (-1 when nothing matched). On entering an accelerable state
+// the self-loop run is skipped with scanRun.
+template <typename Cell, typename Sink>
+inline int runLongestMatch(const DFAView &d, const Cell *table, Cell dead,
+                           const std::string &s, int pos, Sink &sink, int *acceptState) {
+    const size_t alphabet = (size_t)d.alphabet;
+    const uint8_t *classOf = d.classOf;
+    const unsigned char *p = (const unsigned char *)s.data();
+    const int n = (int)s.size();
+    int cur = d.start;
+    int lastAcceptPos = -1, lastAcceptState = -1;
+    bool entered = true; // the start state is "entered" before the first byte
+    for (int i = pos; i < n;) {
+        if (entered && d.accelIndex[cur] >= 0) {
+            int run = (int)scanRun(d.accel[d.accelIndex[cur]], p + i, (size_t)(n - i));
+            sink.run(cur, run);
+            i += run;
+            if (run > 0 && d.isAccept(cur)) { lastAcceptPos = i - 1; lastAcceptState = cur; }
+            if (i >= n) break;
+        }
+        Cell nxt = table[(size_t)cur * alphabet + classOf[p[i]]];
+        if (nxt == dead) break;
+        entered = (int)nxt != cur;
+        cur = nxt;
+        sink.state(cur);
+        if (d.isAccept(cur)) { lastAcceptPos = i; lastAcceptState = cur; }
+        ++i;
+    }
+    *acceptState = lastAcceptState;
+    return lastAcceptPos >= 0 ? (lastAcceptPos - pos + 1) : 0;
+}
+
+// Interleaved form of runLongestMatch for count <= MATCH_BATCH_MAX streams:
+// each round advances every busy stream by one transition, so the table
+// loads of different streams are independent and overlap in the memory
+// pipeline. Each stream keeps its own cursor and last-accept bookkeeping.
+// Accepts are recorded with conditional moves and self-loop runs are not
+// skipped: with streams interleaved, data-dependent branches lose the
+// history that makes them predictable in the single-stream loop.
+// When stream k finishes a match its len and tag are set and next(k, stream)
+// is called: it may point the stream at a new pos (and input) and return
+// true to keep the lane busy, or return false to retire it. The call
+// returns when every stream is retired.
+// Tagged: each lane also keeps the tag registers of runTaggedLongestMatch,
+// and a stream with tagPos set gets the winning token's tag positions there.
+template <bool Tagged, typename Cell, typename Next>
+inline void runLongestMatchBatch(const DFAView &d, const Cell *table, Cell dead,
+                                 MatchStream *streams, int count, Next &next) {
+    struct Lane {
+        const unsigned char *p;
+        int i, n, cur, lastAcceptPos, lastAcceptState;
+    };
+    Lane lanes[MATCH_BATCH_MAX];
+    int regs[MATCH_BATCH_MAX][Tagged ? MAX_TAGS : 1];
+    const size_t alphabet = (size_t)d.alphabet;
+    const uint8_t *classOf = d.classOf;
+    const uint64_t *acceptBits = d.acceptBits;
+    const int numTags = Tagged ? d.numTags : 0;
+    auto start = [&](int k) {
+        const std::string &s = *streams[k].input;
+        lanes[k] = { (const unsigned char *)s.data(), streams[k].pos, (int)s.size(), d.start, -1, -1 };
+        if (!Tagged) return;
+        for (int t = 0; t < numTags; ++t) {
+            regs[k][t] = (d.tagSet[d.start] >> t) & 1 ? streams[k].pos : -1;
+            if (streams[k].tagPos) streams[k].tagPos[t] = -1;
+        }
+    };
+    for (int k = 0; k < count; ++k) start(k);
+    int busy = count;
+    while (busy > 0) {
+        for (int k = 0; k < count; ++k) {
+            Lane &L = lanes[k];
+            if (L.cur < 0) continue; // retired
+            bool done = L.i >= L.n;
+            if (!done) {
+                Cell nxt = table[(size_t)L.cur * alphabet + classOf[L.p[L.i]]];
+                done = nxt == dead;
+                if (!done) {
+                    int s = (int)nxt;
+                    bool acc = (acceptBits[s >> 6] >> (s & 63)) & 1;
+                    if (Tagged) {
+                        if (uint32_t tags = d.tagSet[s])
+                            for (int t = 0; t < numTags; ++t) if ((tags >> t) & 1) regs[k][t] = L.i + 1;
+                        uint32_t use = acc ? d.tagUse[s] : 0;
+                        if (use && streams[k].tagPos)
+                            for (int t = 0; t < numTags; ++t) if ((use >> t) & 1) streams[k].tagPos[t] = regs[k][t];
+                    }
+                    L.lastAcceptPos = acc ? L.i : L.lastAcceptPos;
+                    L.lastAcceptState = acc ? s : L.lastAcceptState;
+                    L.cur = s;
+                    done = ++L.i >= L.n;
+                }
+            }
+            if (!done) continue;
+            MatchStream &m = streams[k];
+            m.len = L.lastAcceptPos >= 0 ? L.lastAcceptPos - m.pos + 1 : 0;
+            m.tag = L.lastAcceptState >= 0 ? d.acceptTag[L.lastAcceptState] : -1;
+            // tags the winning token does not have stay -1
+            if (Tagged && m.tagPos && L.lastAcceptState >= 0) {
+                for (int t = 0; t < numTags; ++t)
+                    if (!((d.tagUse[L.lastAcceptState] >> t) & 1)) m.tagPos[t] = -1;
+            }
+            if (next(k, m)) start(k);
+            else { L.cur = -1; --busy; }
+        }
+    }
+}
+
+// Lockstep matching of count streams with the refill callback described at
+// runLongestMatchBatch; larger counts are matched MATCH_BATCH_MAX at a time.
+// v must be non-empty with a valid start state. Tags are tracked only for a
+// group in which some stream asks for them.
+template <typename Next>
+inline void matchStreams(const DFAView &v, MatchStream *streams, int count, Next next) {
+    for (int first = 0; first < count; first += MATCH_BATCH_MAX) {
+        int group = std::min(MATCH_BATCH_MAX, count - first);
+        auto shifted = [&](int k, MatchStream &m) { return next(first + k, m); };
+        bool tagged = false;
+        for (int k = first; v.numTags > 0 && k < first + group; ++k) tagged = tagged || streams[k].tagPos;
+        if (tagged) {
+            if (v.table16) runLongestMatchBatch<true>(v, v.table16, DFA_DEAD16, streams + first, group, shifted);
+            else runLongestMatchBatch<true>(v, v.table, (int32_t)DFA_DEAD, streams + first, group, shifted);
+        } else {
+            if (v.table16) runLongestMatchBatch<false>(v, v.table16, DFA_DEAD16, streams + first, group, shifted);
+            else runLongestMatchBatch<false>(v, v.table, (int32_t)DFA_DEAD, streams + first, group, shifted);
+        }
+    }
+}
+
+// Longest match from pos on v with sink observing the states entered. Sinks
+// that record nothing run on the shuffle engine when v has one (sheng.h).
+// v must be non-empty with a valid start state.
+template <typename Sink>
+inline int matchLongest(const DFAView &v, const std::string &s, int pos, Sink &sink, int *acceptState) {
+    if (!Sink::observes && v.sheng && shengSupported())
+        return shengLongestMatch(v, s, pos, acceptState);
+    return v.table16
+        ? runLongestMatch(v, v.table16, DFA_DEAD16, s, pos, sink, acceptState)
+        : runLongestMatch(v, v.table, (int32_t)DFA_DEAD, s, pos, sink, acceptState);
+}
+
+// runLongestMatch on a tagged DFA (tagdfa.h). One register per tag holds the
+// position it was last set to; entering a state sets its tagSet tags to the
+// position after the byte just read (the start state: to pos). The registers
+// the accepting state reports are copied out at every accept, so tags set
+// while reading past the last accept are not seen. A skipped self-loop run
+// sets the tags once, at its end. tagPos gets d.numTags entries (-1: not set).
+template <typename Cell>
+inline int runTaggedLongestMatch(const DFAView &d, const Cell *table, Cell dead,
+                                 const std::string &s, int pos, int *tagPos, int *acceptState) {
+    const size_t alphabet = (size_t)d.alphabet;
+    const uint8_t *classOf = d.classOf;
+    const unsigned char *p = (const unsigned char *)s.data();
+    const int n = (int)s.size();
+    const int numTags = d.numTags;
+    int reg[MAX_TAGS];
+    for (int t = 0; t < numTags; ++t) {
+        reg[t] = (d.tagSet[d.start] >> t) & 1 ? pos : -1;
+        tagPos[t] = -1;
+    }
+    auto setTags = [&](uint32_t mask, int at) {
+        for (int t = 0; t < numTags; ++t) if ((mask >> t) & 1) reg[t] = at;
+    };
+    int cur = d.start;
+    int lastAcceptPos = -1, lastAcceptState = -1;
+    auto record = [&](int state, int at) {
+        lastAcceptPos = at; lastAcceptState = state;
+        uint32_t use = d.tagUse[state];
+        if (use) for (int t = 0; t < numTags; ++t) if ((use >> t) & 1) tagPos[t] = reg[t];
+    };
+    bool entered = true;
+    for (int i = pos; i < n;) {
+        if (entered && d.accelIndex[cur] >= 0) {
+            int run = (int)scanRun(d.accel[d.accelIndex[cur]], p + i, (size_t)(n - i));
+            i += run;
+            if (run > 0) {
+                setTags(d.tagSet[cur], i);
+                if (d.isAccept(cur)) record(cur, i - 1);
+            }
+            if (i >= n) break;
+        }
+        Cell nxt = table[(size_t)cur * alphabet + classOf[p[i]]];
+        if (nxt == dead) break;
+        entered = (int)nxt != cur;
+        cur = nxt;
+        ++i;
+        if (uint32_t tags = d.tagSet[cur]) setTags(tags, i);
+        if (d.isAccept(cur)) record(cur, i - 1);
+    }
+    // tags the winning token does not have stay -1
+    if (lastAcceptState >= 0) {
+        for (int t = 0; t < numTags; ++t)
+            if (!((d.tagUse[lastAcceptState] >> t) & 1)) tagPos[t] = -1;
+    }
+    *acceptState = lastAcceptState;
+    return lastAcceptPos >= 0 ? (lastAcceptPos - pos + 1) : 0;
+}
+
+// Memo of Reps' maximal munch ("Maximal-munch tokenization in linear time",
+// TOPLAS 1998): a pair (state q, position i) is failed when no accept is
+// reachable from q before reading byte i. That is a fact about the input, so
+// it stays true for every later token; a scan that reaches a failed pair
+// stops there. Every pair is then scanned past at most once, which bounds a
+// whole tokenization by O(n * states) even when the lexer has unbounded
+// lookahead (dfaLookahead() < 0). One memo belongs to one input.
+struct MunchMemo {
+    std::unordered_set<uint64_t> failed;   // (position << 32 | state)
+    int maxPos = -1;                       // largest position in failed
+    std::vector<std::pair<int,int>> trail; // (state, position) entered since the last accept
+};
+
+// runLongestMatch with the memo; byte at a time (no self-loop skipping), so
+// every pair entered can be checked and recorded. With tagPos set, the tag
+// registers of runTaggedLongestMatch are kept as well: a scan only stops
+// early at a failed pair, past which no accept lies, so the winning accept
+// and its tag positions are the ones the plain scan would find.
+template <typename Cell>
+inline int runMemoLongestMatch(const DFAView &d, const Cell *table, Cell dead,
+                               const std::string &s, int pos, MunchMemo &memo,
+                               int *tagPos, int *acceptState) {
+    const size_t alphabet = (size_t)d.alphabet;
+    const uint8_t *classOf = d.classOf;
+    const unsigned char *p = (const unsigned char *)s.data();
+    const int n = (int)s.size();
+    const int numTags = tagPos ? d.numTags : 0;
+    int reg[MAX_TAGS];
+    for (int t = 0; t < numTags; ++t) {
+        reg[t] = (d.tagSet[d.start] >> t) & 1 ? pos : -1;
+        tagPos[t] = -1;
+    }
+    auto isFailed = [&memo](int q, int i) {
+        return i <= memo.maxPos && memo.failed.count((uint64_t)i << 32 | (uint32_t)q) != 0;
+    };
+    // facts older than this scan can never be reached again
+    if (pos > memo.maxPos && !memo.failed.empty()) memo.failed.clear();
+    memo.trail.clear();
+    int cur = d.start;
+    int lastAcceptPos = -1, lastAcceptState = -1;
+    if (!isFailed(cur, pos)) {
+        memo.trail.push_back({ cur, pos });
+        for (int i = pos; i < n;) {
+            Cell nxt = table[(size_t)cur * alphabet + classOf[p[i]]];
+            if (nxt == dead) break;
+            cur = nxt;
+            if (numTags) {
+                uint32_t tags = d.tagSet[cur];
+                for (int t = 0; tags && t < numTags; ++t) if ((tags >> t) & 1) reg[t] = i + 1;
+            }
+            if (d.isAccept(cur)) {
+                lastAcceptPos = i; lastAcceptState = cur;
+                uint32_t use = numTags ? d.tagUse[cur] : 0;
+                for (int t = 0; use && t < numTags; ++t) if ((use >> t) & 1) tagPos[t] = reg[t];
+                memo.trail.clear();
+                ++i;
+                continue;
+            }
+            ++i;
+            if (isFailed(cur, i)) break;
+            memo.trail.push_back({ cur, i });
+        }
+    }
+    // nothing after the last accept led to another one
+    for (const auto &e : memo.trail) {
+        memo.failed.insert((uint64_t)e.second << 32 | (uint32_t)e.first);
+        memo.maxPos = std::max(memo.maxPos, e.second);
+    }
+    // tags the winning token does not have stay -1
+    if (numTags && lastAcceptState >= 0) {
+        for (int t = 0; t < numTags; ++t)
+            if (!((d.tagUse[lastAcceptState] >> t) & 1)) tagPos[t] = -1;
+    }
+    *acceptState = lastAcceptState;
+    return lastAcceptPos >= 0 ? (lastAcceptPos - pos + 1) : 0;
+}
+
+// Longest match from pos with the memo (v non-empty with a valid start state).
+// tagPos, when set, gets v.numTags tag positions as dfaLongestMatchCaptures
+// reports them.
+inline int memoLongestMatch(const DFAView &v, const std::string &s, int pos, MunchMemo &memo,
+                            int *acceptState, int *tagPos = nullptr) {
+    return v.table16
+        ? runMemoLongestMatch(v, v.table16, DFA_DEAD16, s, pos, memo, tagPos, acceptState)
+        : runMemoLongestMatch(v, v.table, (int32_t)DFA_DEAD, s, pos, memo, tagPos, acceptState);
+}
+
+#endif // MATCHER_H
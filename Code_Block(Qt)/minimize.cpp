@@ -0,0 +1,174 @@
+#include "minimize.h"
+#include <chrono>
+#include <map>
+#include <tuple>
+
+// Hopcroft partition refinement
+DFA minimizeDFA(const DFA &d) {
+    auto t0 = std::chrono::steady_clock::now();
+    const int n = d.numStates;
+    const int N = n + 1;          // state n is the implicit dead state
+    const int dead = n;
+    if (n == 0) return d;
+
+    // only classes with at least one live edge can split blocks; the rest go
+    // to the dead state from everywhere
+    std::vector<int> syms;
+    for (int c = 0; c < d.alphabet; ++c) {
+        for (int s = 0; s < n; ++s) {
+            if (d.step(s, c) != DFA_DEAD) { syms.push_back(c); break; }
+        }
+    }
+    const int k = (int)syms.size();
+    auto delta = [&](int q, int j) {
+        if (q == dead) return dead;
+        int t = d.step(q, syms[j]);
+        return t == DFA_DEAD ? dead : t;
+    };
+
+    // inverse transitions per symbol (CSR: predStart[j*(N+1)+t] .. predStart[j*(N+1)+t+1])
+    std::vector<int> predStart((size_t)k * (N + 1), 0), predList((size_t)k * N);
+    for (int j = 0; j < k; ++j) {
+        int *ps = &predStart[(size_t)j * (N + 1)];
+        for (int q = 0; q < N; ++q) ++ps[delta(q, j) + 1];
+        for (int t = 0; t < N; ++t) ps[t + 1] += ps[t];
+        std::vector<int> fill(ps, ps + N);
+        for (int q = 0; q < N; ++q) predList[(size_t)j * N + fill[delta(q, j)]++] = q;
+    }
+
+    // initial partition: one block per accept tag plus non-accepting (dead joins the latter);
+    // on a tagged DFA states must also set and report the same tags
+    std::vector<int> elems(N), loc(N), blk(N);
+    std::vector<int> bFirst, bEnd, bMarked;
+    {
+        std::vector<int> key(N, 0);
+        int numKeys = 1;
+        std::map<std::tuple<int, uint32_t, uint32_t>, int> tagKeys;
+        if (d.numTags > 0) tagKeys[std::make_tuple(0, 0u, 0u)] = 0;
+        for (int q = 0; q < n; ++q) {
+            key[q] = d.isAccept(q) ? d.acceptTag[q] + 1 : 0;
+            if (d.numTags > 0) {
+                auto ins = tagKeys.insert({ std::make_tuple(key[q], d.tagSet[q], d.tagUse[q]), (int)tagKeys.size() });
+                key[q] = ins.first->second;
+            }
+            numKeys = std::max(numKeys, key[q] + 1);
+        }
+        std::vector<int> keyBlock(numKeys, -1), count(numKeys, 0);
+        for (int q = 0; q < N; ++q) ++count[key[q]];
+        int pos = 0;
+        for (int kv = 0; kv < numKeys; ++kv) {
+            if (!count[kv]) continue;
+            keyBlock[kv] = (int)bFirst.size();
+            bFirst.push_back(pos); bEnd.push_back(pos); bMarked.push_back(0);
+            pos += count[kv];
+        }
+        for (int q = 0; q < N; ++q) {
+            int b = keyBlock[key[q]];
+            blk[q] = b;
+            loc[q] = bEnd[b];
+            elems[bEnd[b]++] = q;
+        }
+    }
+
+    // worklist of (block, symbol) splitters
+    std::vector<char> inW((size_t)N * std::max(k, 1), 0);
+    std::vector<std::pair<int,int>> W;
+    for (int b = 0; b < (int)bFirst.size(); ++b)
+        for (int j = 0; j < k; ++j) { W.push_back({b, j}); inW[(size_t)b * k + j] = 1; }
+
+    std::vector<int> splitter, touched;
+    while (!W.empty()) {
+        auto [a, j] = W.back(); W.pop_back();
+        inW[(size_t)a * k + j] = 0;
+        splitter.assign(elems.begin() + bFirst[a], elems.begin() + bEnd[a]);
+
+        // mark every predecessor on symbol j, moving it to the front of its block
+        const int *ps = &predStart[(size_t)j * (N + 1)];
+        const int *pl = &predList[(size_t)j * N];
+        for (int q : splitter) {
+            for (int x = ps[q]; x < ps[q + 1]; ++x) {
+                int p = pl[x], b = blk[p];
+                int boundary = bFirst[b] + bMarked[b];
+                if (loc[p] < boundary) continue; // already marked
+                if (bMarked[b] == 0) touched.push_back(b);
+                int other = elems[boundary];
+                std::swap(elems[loc[p]], elems[boundary]);
+                loc[other] = loc[p];
+                loc[p] = boundary;
+                ++bMarked[b];
+            }
+        }
+
+        // split every block that was only partially marked
+        for (int b : touched) {
+            int m = bMarked[b];
+            bMarked[b] = 0;
+            if (m == bEnd[b] - bFirst[b]) continue;
+            int nb = (int)bFirst.size();
+            bFirst.push_back(bFirst[b]); bEnd.push_back(bFirst[b] + m); bMarked.push_back(0);
+            bFirst[b] += m;
+            for (int x = bFirst[nb]; x < bEnd[nb]; ++x) blk[elems[x]] = nb;
+            int smaller = (bEnd[nb] - bFirst[nb] <= bEnd[b] - bFirst[b]) ? nb : b;
+            for (int jj = 0; jj < k; ++jj) {
+                int add = inW[(size_t)b * k + jj] ? nb : smaller;
+                if (!inW[(size_t)add * k + jj]) { inW[(size_t)add * k + jj] = 1; W.push_back({add, jj}); }
+            }
+        }
+        touched.clear();
+    }
+
+    // renumber surviving blocks in BFS order from the start block
+    const int deadBlock = blk[dead];
+    const int numBlocks = (int)bFirst.size();
+    std::vector<int> newId(numBlocks, DFA_DEAD), order;
+    if (blk[d.start] != deadBlock) { newId[blk[d.start]] = 0; order.push_back(blk[d.start]); }
+    for (size_t idx = 0; idx < order.size(); ++idx) {
+        int rep = elems[bFirst[order[idx]]];
+        for (int c = 0; c < d.alphabet; ++c) {
+            int t = d.step(rep, c);
+            if (t == DFA_DEAD || blk[t] == deadBlock || newId[blk[t]] != DFA_DEAD) continue;
+            newId[blk[t]] = (int)order.size();
+            order.push_back(blk[t]);
+        }
+    }
+
+    DFA m;
+    m.classOf = d.classOf;
+    m.alphabet = d.alphabet;
+    m.start = 0;
+    m.numStates = std::max<int>(1, (int)order.size()); // empty language keeps a lone start state
+    m.table.assign((size_t)m.numStates * m.alphabet, DFA_DEAD);
+    m.acceptBits.assign((m.numStates + 63) / 64, 0);
+    m.acceptTag.assign(m.numStates, -1);
+    m.rev.resize(m.numStates);
+    m.origin.resize(m.numStates);
+    m.numTags = d.numTags;
+    if (d.numTags > 0) { m.tagSet.assign(m.numStates, 0); m.tagUse.assign(m.numStates, 0); }
+    m.originRev = d.rev;
+    for (int id = 0; id < (int)order.size(); ++id) {
+        int b = order[id];
+        for (int x = bFirst[b]; x < bEnd[b]; ++x) m.origin[id].push_back(elems[x]);
+        std::sort(m.origin[id].begin(), m.origin[id].end());
+        for (int q : m.origin[id]) {
+            if (q < (int)d.rev.size()) m.rev[id].insert(m.rev[id].end(), d.rev[q].begin(), d.rev[q].end());
+        }
+        std::sort(m.rev[id].begin(), m.rev[id].end());
+        m.rev[id].erase(std::unique(m.rev[id].begin(), m.rev[id].end()), m.rev[id].end());
+        int rep = m.origin[id].front();
+        if (d.isAccept(rep)) {
+            m.acceptBits[id >> 6] |= 1ull << (id & 63);
+            m.acceptTag[id] = d.acceptTag[rep];
+        }
+        if (d.numTags > 0) { m.tagSet[id] = d.tagSet[rep]; m.tagUse[id] = d.tagUse[rep]; }
+        for (int c = 0; c < d.alphabet; ++c) {
+            int t = d.step(rep, c);
+            if (t != DFA_DEAD && blk[t] != deadBlock) m.table[(size_t)id * m.alphabet + c] = newId[blk[t]];
+        }
+    }
+    m.stats = d.stats;
+    m.stats.statesBefore = n;
+    m.stats.statesAfter = m.numStates;
+    packDFA(m);
+    m.stats.minimizeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return m;
+}
@@ -0,0 +1,14 @@
+#ifndef MINIMIZE_H
+#define MINIMIZE_H
+
+#include "dfa.h"
+
+// Hopcroft partition refinement (O(n*k*log n)). Merges equivalent states and
+// drops states that can never reach an accept. The result keeps provenance:
+// rev[i] is the union of the merged NFA sets and origin[i] lists the
+// pre-minimization state ids, whose sets stay available in originRev.
+// Position tags (tagdfa.h) are kept: only states that set and report the
+// same tags are merged.
+DFA minimizeDFA(const DFA &d);
+
+#endif // MINIMIZE_H
@@ -63,6 +63,106 @@ Fragment optFrag(NFA &n, const Fragment &a) {
     return {s,t};
 }
 
+// bounded repetition allowed{min,max}: s enters the counted loop q on the
+// first byte, q loops on the rest and leaves for t once the count allows
+Fragment repeatFrag(NFA &n, const std::vector<char>& allowed, int min, int max) {
+    min = std::max(min, 0);
+    if (max >= 0 && max < min) max = min;
+    if (max == 0) return makeChar(n, 0);
+    int len = max < 0 ? std::max(min, 1) : max;
+    if (len > MAX_COUNT) {
+        // too wide for a register: min copies, then optional ones (or a star)
+        Fragment f = makeChar(n, 0);
+        for (int k = 0; k < min; ++k) f = concatFrag(n, f, makeCharClass(n, allowed));
+        if (max < 0) return concatFrag(n, f, starFrag(n, makeCharClass(n, allowed)));
+        for (int k = min; k < max; ++k) f = concatFrag(n, f, optFrag(n, makeCharClass(n, allowed)));
+        return f;
+    }
+    int s = n.newState();
+    int q = n.newState();
+    int t = n.newState();
+    for (char c : allowed) { n.addTrans(s, c, q); n.addTrans(q, c, q); }
+    n.addEps(q, t);
+    if (min == 0) n.addEps(s, t);
+    n.counterOf[q] = { std::max(min, 1), max, t };
+    return {s,t};
+}
+
+// counted loop q expanded into copies q = q_1 .. q_len: q_k takes one byte
+// to q_k+1 and leaves for exit when k >= min; without an upper bound the
+// last copy keeps the loop
+NFA expandCounters(const NFA &n) {
+    NFA e = n;
+    e.counterOf.clear();
+    for (const auto &kv : n.counterOf) {
+        const int q = kv.first;
+        const NFACounter &c = kv.second;
+        const int len = c.max < 0 ? c.min : c.max;
+        NFAState body = n.states[q];
+        std::vector<char> loop;
+        for (auto it = body.trans.begin(); it != body.trans.end();) {
+            if (it->second.erase(q)) loop.push_back(it->first);
+            it = it->second.empty() ? body.trans.erase(it) : std::next(it);
+        }
+        body.eps.erase(c.exit);
+        auto acc = n.acceptTag.find(q);
+        std::vector<int> copies(1, q);
+        for (int k = 1; k < len; ++k) copies.push_back(e.newState());
+        for (int k = 0; k < len; ++k) {
+            NFAState &st = e.states[copies[k]];
+            st.trans = body.trans;
+            st.eps = body.eps;
+            int next = k + 1 < len ? copies[k + 1] : c.max < 0 ? copies[k] : -1;
+            if (next >= 0) for (char b : loop) st.trans[b].insert(next);
+            if (k + 1 >= c.min) st.eps.insert(c.exit);
+            if (k > 0 && n.accepts.count(q)) {
+                e.accepts.insert(copies[k]);
+                if (acc != n.acceptTag.end()) e.acceptTag[copies[k]] = acc->second;
+            }
+        }
+    }
+    return e;
+}
+
+// position tag: the start state records the tag, then moves on without input
+Fragment makeTag(NFA &n, int tag) {
+    int s = n.newState();
+    int t = n.newState();
+    n.addEps(s, t);
+    n.tagOf[s] = tag;
+    return {s,t};
+}
+
+// capture k: open tag, a, close tag
+Fragment captureFrag(NFA &n, const Fragment &a, int capture) {
+    Fragment open = makeTag(n, 2 * capture);
+    Fragment inner = concatFrag(n, open, a);
+    return concatFrag(n, inner, makeTag(n, 2 * capture + 1));
+}
+
+int nfaTagCount(const NFA &n) {
+    int count = 0;
+    for (const auto &kv : n.tagOf) count = std::max(count, kv.second + 1);
+    return count;
+}
+
+// Copy all states of src into dst (ids shifted); returns the id offset
+int appendNFA(NFA &dst, const NFA &src) {
+    int off = (int)dst.states.size();
+    for (const NFAState &s : src.states) {
+        NFAState c;
+        c.id = s.id + off;
+        for (const auto &kv : s.trans)
+            for (int t : kv.second) c.trans[kv.first].insert(t + off);
+        for (int t : s.eps) c.eps.insert(t + off);
+        dst.states.push_back(c);
+    }
+    for (const auto &kv : src.tagOf) dst.tagOf[kv.first + off] = kv.second;
+    for (const auto &kv : src.counterOf)
+        dst.counterOf[kv.first + off] = { kv.second.min, kv.second.max, kv.second.exit + off };
+    return off;
+}
+
 // Helper: fill vector with range [a..b] inclusive
 void pushRange(std::vector<char>& v, char a, char b) {
     for (unsigned char c = (unsigned char)a; c <= (unsigned char)b; ++c) v.push_back((char)c);
@@ -96,16 +196,21 @@ NFA buildNumberNFA_thompson() {
     // digit class
     std::vector<char> digits;
     pushRange(digits, '0','9');
-    Fragment digit = makeCharClass(n, digits);
-    // digits+  -> we implement plus as one digit then star(digit)
-    Fragment digitsPlus = concatFrag(n, digit, starFrag(n, digit));
-    // fractional part: '.' followed by digits+
+    // integer part: digits+ (one digit then star(digit)), captured
+    Fragment intDigit = makeCharClass(n, digits);
+    Fragment intDigits = concatFrag(n, intDigit, starFrag(n, intDigit));
+    Fragment intPart = captureFrag(n, intDigits, NUMBER_INT);
+    // fractional part: '.' followed by its own digits+ (sharing the integer
+    // part's states would let the fraction repeat), digits captured; so
+    // "1.2.3" lexes as Number "1.2", Unknown ".", Number "3"
     Fragment dot = makeChar(n, '.');
-    Fragment frac = concatFrag(n, dot, digitsPlus);
+    Fragment fracDigit = makeCharClass(n, digits);
+    Fragment fracDigits = concatFrag(n, fracDigit, starFrag(n, fracDigit));
+    Fragment frac = concatFrag(n, dot, captureFrag(n, fracDigits, NUMBER_FRAC));
     // optional fractional: (frac)?
     Fragment fracOpt = optFrag(n, frac);
-    // final: digitsPlus concat fracOpt
-    Fragment full = concatFrag(n, digitsPlus, fracOpt);
+    // final: integer part concat fracOpt
+    Fragment full = concatFrag(n, intPart, fracOpt);
     n.start = full.start;
     n.accepts.insert(full.accept);
     return n;
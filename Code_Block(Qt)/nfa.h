@@ -5,16 +5,24 @@
 #include <set>
 #include <map>
 #include <string>
-#include <cctype>
 #include <algorithm>
 
-// Character helpers
-inline bool isLetter(char c) { return std::isalpha((unsigned char)c) != 0; }
-inline bool isDigit(char c) { return std::isdigit((unsigned char)c) != 0; }
+// Character helpers (ASCII only and locale independent; non-ASCII identifier
+// characters are handled by the UTF-8 automata in utf8.h)
+inline bool isLetter(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
 inline bool isIdentifierChar(char c) { return isLetter(c) || isDigit(c) || c == '_'; }
 inline bool isWhitespace(char c) { return c==' '||c=='\t'||c=='\n'||c=='\r'||c=='\f'||c=='\v'; }
 inline bool isPrintable(char c) { return (unsigned char)c >= 32 && (unsigned char)c < 127; }
 
+// Counted loop of repeatFrag: the state loops on a character class while a
+// counter register holds how many bytes it has taken, and its eps edge to
+// exit is only taken once the count reaches min (max -1: no upper bound)
+struct NFACounter { int min, max, exit; };
+
+// Most bytes a counter register tracks (one bit per count, see counting.h)
+const int MAX_COUNT = 64;
+
 // NFA representation (Thompson-style)
 struct NFAState {
     int id;
@@ -26,6 +34,9 @@ struct NFA {
     std::vector<NFAState> states;
     int start = -1;
     std::set<int> accepts;
+    std::map<int, int> acceptTag;        // accept state -> token tag (lower tag wins); untagged accepts use 0
+    std::map<int, int> tagOf;            // eps-only state -> position tag a match records when passing it
+    std::map<int, NFACounter> counterOf; // counted loop state -> its bounds (repeatFrag)
 
     int newState() {
         NFAState s;
@@ -40,6 +51,15 @@ struct NFA {
 
 struct Fragment { int start, accept; };
 
+// Position tags per NFA (one bit each in the tag masks of a tagged DFA)
+const int MAX_TAGS = 32;
+
+// Number of position tags used (highest tag + 1), 0 for an untagged NFA
+int nfaTagCount(const NFA &n);
+
+// Copy all states of src into dst (ids shifted); returns the id offset
+int appendNFA(NFA &dst, const NFA &src);
+
 // Thompson helpers: build small NFAs and combine (concatenation, union, star, plus, optional)
 Fragment makeChar(NFA &n, char c);
 Fragment makeCharClass(NFA &n, const std::vector<char>& allowed);
@@ -49,6 +69,25 @@ Fragment starFrag(NFA &n, const Fragment &a);
 Fragment plusFrag(NFA &n, const Fragment &a);
 Fragment optFrag(NFA &n, const Fragment &a);
 
+// Bounded repetition of a character class, allowed{min,max} (max -1 for no
+// upper bound): one counted loop state instead of max copies. Bounds a
+// counter register cannot hold (more than MAX_COUNT) are expanded into
+// copies here. A counted loop is only entered through labeled edges.
+Fragment repeatFrag(NFA &n, const std::vector<char>& allowed, int min, int max);
+
+// The same NFA with every counted loop expanded into plain copies (new states
+// go at the end, so existing ids keep their meaning). Subset construction and
+// the other determinizing stages run on this; see flattenNFA.
+NFA expandCounters(const NFA &n);
+
+// Position tag: an empty fragment that records where the match passed it
+Fragment makeTag(NFA &n, int tag);
+// Capture k: a between position tags 2k (open) and 2k+1 (close)
+Fragment captureFrag(NFA &n, const Fragment &a, int capture);
+
+// Sub-token captures of the number NFA
+enum NumberCapture { NUMBER_INT = 0, NUMBER_FRAC, NUMBER_CAPTURE_COUNT };
+
 // Build NFAs for the project regexes using Thompson construction
 void pushRange(std::vector<char>& v, char a, char b);
 NFA buildIdentifierNFA_thompson();
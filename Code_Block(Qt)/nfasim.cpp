@@ -0,0 +1,59 @@
+#include "nfasim.h"
+
+NFASimulator::NFASimulator(const NFA &n) : m_nfa(flattenNFA(n, true)) {
+    if (n.start < 0) return;
+    if (!m_nfa.counters.empty()) { countingStart(m_nfa, m_startConfig, m_scratch); return; }
+    m_startSet.push_back(n.start);
+    epsClosureInto(m_nfa, m_startSet, m_scratch);
+}
+
+// Longest match from pos; *tag gets the winning accept tag (-1 when none)
+int NFASimulator::longestMatch(const std::string &s, int pos, int *tag) {
+    if (!m_nfa.counters.empty()) return longestMatchCounting(s, pos, tag);
+    const unsigned char *p = (const unsigned char *)s.data();
+    int lastAcceptPos = -1, lastTag = -1;
+    m_cur = m_startSet;
+    for (int i = pos; i < (int)s.size() && !m_cur.empty(); ++i) {
+        // targets on p[i], closed as they are found; the set stays unsorted
+        const int b = p[i];
+        uint32_t g = m_scratch.nextGen(m_nfa.numStates);
+        int acc = -1;
+        m_next.clear();
+        for (int q : m_cur) {
+            for (int r = m_nfa.rangeStart[q]; r < m_nfa.rangeStart[q + 1]; ++r) {
+                const NFARange &rg = m_nfa.ranges[r];
+                if (b < rg.lo || b > rg.hi || m_scratch.mark[rg.to] == g) continue;
+                m_scratch.mark[rg.to] = g;
+                m_scratch.stack.push_back(rg.to);
+                while (!m_scratch.stack.empty()) {
+                    int t = m_scratch.stack.back(); m_scratch.stack.pop_back();
+                    m_next.push_back(t);
+                    int a = m_nfa.acceptTag[t];
+                    if (a >= 0 && (acc < 0 || a < acc)) acc = a;
+                    for (int e = m_nfa.epsStart[t]; e < m_nfa.epsStart[t + 1]; ++e) {
+                        int u = m_nfa.epsTo[e];
+                        if (m_scratch.mark[u] != g) { m_scratch.mark[u] = g; m_scratch.stack.push_back(u); }
+                    }
+                }
+            }
+        }
+        m_cur.swap(m_next);
+        if (acc >= 0) { lastAcceptPos = i; lastTag = acc; }
+    }
+    if (tag) *tag = lastTag;
+    return lastAcceptPos >= 0 ? (lastAcceptPos - pos + 1) : 0;
+}
+
+// Same with counted loops: each step also carries the counts (counting.h)
+int NFASimulator::longestMatchCounting(const std::string &s, int pos, int *tag) {
+    const unsigned char *p = (const unsigned char *)s.data();
+    int lastAcceptPos = -1, lastTag = -1;
+    m_curConfig = m_startConfig;
+    for (int i = pos; i < (int)s.size() && !m_curConfig.states.empty(); ++i) {
+        int acc = countingStep(m_nfa, m_curConfig, p[i], m_nextConfig, m_scratch);
+        std::swap(m_curConfig, m_nextConfig);
+        if (acc >= 0) { lastAcceptPos = i; lastTag = acc; }
+    }
+    if (tag) *tag = lastTag;
+    return lastAcceptPos >= 0 ? (lastAcceptPos - pos + 1) : 0;
+}
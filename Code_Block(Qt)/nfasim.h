@@ -0,0 +1,34 @@
+#ifndef NFASIM_H
+#define NFASIM_H
+
+#include "dfa.h"
+#include "counting.h"
+#include <string>
+
+// Thompson simulation of a token spec: the matcher tracks every NFA state a
+// match could be in, so nothing is determinized. A byte costs time in
+// proportion to the live states, far more than one table lookup, but there
+// is no construction cost and no cache to thrash on specs whose DFA blows up.
+// Counted loops (repeatFrag) are simulated with their counts (counting.h).
+class NFASimulator {
+public:
+    explicit NFASimulator(const NFA &n);
+
+    // Longest match from pos; *tag gets the winning accept tag (-1 when none)
+    int longestMatch(const std::string &s, int pos, int *tag);
+
+    // Live states before the first byte (the planner's estimate of the set size)
+    int startStates() const { return (int)(m_nfa.counters.empty() ? m_startSet.size() : m_startConfig.states.size()); }
+    int numStates() const { return m_nfa.numStates; }
+
+private:
+    FlatNFA m_nfa;
+    NFASet m_startSet;      // closed start set
+    NFASet m_cur, m_next;
+    SubsetScratch m_scratch;
+    CountingSet m_startConfig, m_curConfig, m_nextConfig;  // counting NFAs only
+
+    int longestMatchCounting(const std::string &s, int pos, int *tag);
+};
+
+#endif // NFASIM_H
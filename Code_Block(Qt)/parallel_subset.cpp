@@ -0,0 +1,190 @@
+#include "parallel_subset.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Frontier states handed to a worker at a time
+static const size_t FRONTIER_CHUNK = 32;
+
+static const int SHARD_BITS = 6;
+
+// NFA sets interned from many threads: one lock per shard, picked by the top
+// fingerprint bits (slots use the low bits). Ids are dense but depend on
+// thread timing. Sets live in deques, so interned sets never move.
+class ConcurrentNFASetTable {
+public:
+    ConcurrentNFASetTable() : m_shards(1 << SHARD_BITS) {}
+
+    // Id of s; *stored points at the interned copy when s was new, else nullptr
+    int intern(const NFASet &s, const NFASet **stored);
+    int size() const { return m_next.load(); }
+
+private:
+    struct Shard {
+        std::mutex lock;
+        std::deque<NFASet> sets;
+        std::vector<uint64_t> hash;
+        std::vector<int> ids;
+        std::vector<int> slots; // index into sets or -1
+    };
+    std::vector<Shard> m_shards;
+    std::atomic<int> m_next{0};
+
+    static void rehash(Shard &sh, size_t slots);
+};
+
+int ConcurrentNFASetTable::intern(const NFASet &s, const NFASet **stored) {
+    uint64_t h = hashNFASet(s);
+    Shard &sh = m_shards[h >> (64 - SHARD_BITS)];
+    std::lock_guard<std::mutex> guard(sh.lock);
+    if (sh.slots.size() < 2 * (sh.sets.size() + 1)) rehash(sh, std::max<size_t>(64, sh.slots.size() * 2));
+    size_t mask = sh.slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        int local = sh.slots[i];
+        if (local < 0) {
+            sh.slots[i] = (int)sh.sets.size();
+            sh.sets.push_back(s);
+            sh.hash.push_back(h);
+            sh.ids.push_back(m_next.fetch_add(1));
+            *stored = &sh.sets.back();
+            return sh.ids.back();
+        }
+        if (sh.hash[local] == h && sh.sets[local] == s) {
+            *stored = nullptr;
+            return sh.ids[local];
+        }
+    }
+}
+
+void ConcurrentNFASetTable::rehash(Shard &sh, size_t slots) {
+    sh.slots.assign(slots, -1);
+    size_t mask = slots - 1;
+    for (int local = 0; local < (int)sh.sets.size(); ++local) {
+        size_t i = sh.hash[local] & mask;
+        while (sh.slots[i] >= 0) i = (i + 1) & mask;
+        sh.slots[i] = local;
+    }
+}
+
+// A state discovered during the current level, by provisional id
+struct FrontierState { int id; const NFASet *set; };
+
+DFA subsetConstructionParallel(const NFA &n, int threads) {
+    auto t0 = std::chrono::steady_clock::now();
+    if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+    FlatNFA f = flattenNFA(n);
+    const size_t alphabet = (size_t)f.alphabet;
+    if (n.start < 0) {
+        // an empty NFA matches nothing: no states, as subsetConstruction returns
+        DFA d;
+        d.classOf = f.classOf;
+        d.alphabet = f.alphabet;
+        return d;
+    }
+
+    ConcurrentNFASetTable sets;
+    std::vector<int32_t> table;              // rows by provisional id
+    std::vector<int> accepting;              // provisional id -> winning tag
+    std::vector<const NFASet *> setOf;       // provisional id -> interned set
+    std::vector<SubsetScratch> scratch(threads);
+    std::vector<SubsetRow> rows(threads);
+    std::vector<std::vector<int>> ids(threads);
+    std::vector<std::vector<FrontierState>> found(threads);
+
+    std::vector<FrontierState> frontier;
+    {
+        NFASet start(1, n.start);
+        epsClosureInto(f, start, scratch[0]);
+        const NFASet *stored = nullptr;
+        int id = sets.intern(start, &stored);
+        frontier.push_back({ id, stored });
+    }
+
+    while (!frontier.empty()) {
+        // every state known at the start of a level owns its row before the workers run
+        size_t known = (size_t)sets.size();
+        table.resize(known * alphabet, DFA_DEAD);
+        accepting.resize(known, -1);
+        setOf.resize(known, nullptr);
+        for (const FrontierState &q : frontier) setOf[q.id] = q.set;
+
+        std::atomic<size_t> next{0};
+        auto work = [&](int t) {
+            found[t].clear();
+            for (;;) {
+                size_t begin = next.fetch_add(FRONTIER_CHUNK);
+                if (begin >= frontier.size()) break;
+                size_t end = std::min(begin + FRONTIER_CHUNK, frontier.size());
+                for (size_t q = begin; q < end; ++q) {
+                    const FrontierState &st = frontier[q];
+                    accepting[st.id] = subsetAcceptTag(f, *st.set);
+                    SubsetRow &row = rows[t];
+                    expandSubsetState(f, *st.set, scratch[t], row);
+                    ids[t].resize(row.count);
+                    for (int k = 0; k < row.count; ++k) {
+                        const NFASet *stored = nullptr;
+                        ids[t][k] = sets.intern(row.targets[k], &stored);
+                        if (stored) found[t].push_back({ ids[t][k], stored });
+                    }
+                    int32_t *cells = &table[(size_t)st.id * alphabet];
+                    for (size_t j = 0; j < row.cls.size(); ++j) cells[row.cls[j]] = ids[t][row.target[j]];
+                }
+            }
+        };
+        int workers = (int)std::min<size_t>(threads, (frontier.size() + FRONTIER_CHUNK - 1) / FRONTIER_CHUNK);
+        if (workers <= 1) {
+            workers = 1;
+            work(0);
+        } else {
+            std::vector<std::thread> pool;
+            for (int t = 1; t < workers; ++t) pool.emplace_back(work, t);
+            work(0);
+            for (std::thread &th : pool) th.join();
+        }
+
+        frontier.clear();
+        for (int t = 0; t < workers; ++t) frontier.insert(frontier.end(), found[t].begin(), found[t].end());
+    }
+
+    // deterministic numbering: BFS from the start, classes in representative-byte order
+    const int total = sets.size();
+    std::vector<int> newId(total, DFA_DEAD), order;
+    order.reserve(total);
+    newId[0] = 0;
+    order.push_back(0);
+    for (size_t k = 0; k < order.size(); ++k) {
+        const int32_t *cells = &table[(size_t)order[k] * alphabet];
+        for (int c : f.classesByRep) {
+            int t = cells[c];
+            if (t == DFA_DEAD || newId[t] != DFA_DEAD) continue;
+            newId[t] = (int)order.size();
+            order.push_back(t);
+        }
+    }
+
+    DFA d;
+    d.classOf = f.classOf;
+    d.alphabet = f.alphabet;
+    d.numStates = total;
+    d.start = 0;
+    d.table.assign((size_t)total * alphabet, DFA_DEAD);
+    d.acceptBits.assign((total + 63) / 64, 0);
+    d.acceptTag.assign(total, -1);
+    d.rev.resize(total);
+    for (int id = 0; id < total; ++id) {
+        int old = order[id];
+        const int32_t *cells = &table[(size_t)old * alphabet];
+        for (size_t c = 0; c < alphabet; ++c)
+            if (cells[c] != DFA_DEAD) d.table[(size_t)id * alphabet + c] = newId[cells[c]];
+        d.rev[id] = *setOf[old];
+        d.acceptTag[id] = accepting[old];
+        if (accepting[old] >= 0) d.acceptBits[id >> 6] |= 1ull << (id & 63);
+    }
+    d.stats.nfaStates = f.numStates;
+    d.stats.statesBefore = d.stats.statesAfter = d.numStates;
+    packDFA(d);
+    d.stats.subsetMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return d;
+}
@@ -0,0 +1,15 @@
+#ifndef PARALLEL_SUBSET_H
+#define PARALLEL_SUBSET_H
+
+#include "dfa.h"
+
+// Subset construction on several threads (threads <= 0: one per hardware
+// thread). Workers take chunks of the current BFS frontier, expand them with
+// expandSubsetState and intern the target sets in a lock-striped table.
+// The provisional ids depend on thread timing, so a final BFS renumbering
+// (classes in byte order, as the sequential sweep discovers them) makes the
+// result identical to subsetConstruction(n). Small frontiers are expanded on
+// the calling thread, so small specs pay no threading cost.
+DFA subsetConstructionParallel(const NFA &n, int threads = 0);
+
+#endif // PARALLEL_SUBSET_H
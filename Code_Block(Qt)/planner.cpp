@@ -0,0 +1,275 @@
+#include "planner.h"
+#include "sheng.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+// Cost model, in nanoseconds. The tokenizer loop (whitespace, token text,
+// line/col) is paid by every engine and dominates on short tokens; the
+// engines differ in the step per byte and in their set-up. The per-byte
+// costs are in LexCosts (calibrateLexCosts in lexbench.cpp fits them to the
+// machine); the rest are fixed here.
+static const size_t L1_BYTES = 32 << 10, L2_BYTES = 1 << 20;
+static const double NS_STEP_L1 = 2, NS_STEP_L2 = 4, NS_STEP_MEM = 10;  // table step by table size
+static const double ACCEL_FACTOR = 0.8;         // table step with vector scans on self-loop runs
+static const double NS_THREAD = 60000;          // starting one worker
+static const double NS_MERGE = 3;               // per byte, placing the chunk tokens
+static const double PARALLEL_EFFICIENCY = 0.85;
+static const double NS_FLATTEN = 500;           // per NFA state, set-up of lazy DFA and NFA simulation
+static const double NS_MISS = 300, NS_MISS_STATE = 10;  // determinizing one transition, per set state
+static const double LAZY_STATES_PER_MISS = 40;  // NFA states per transition a typical input takes
+
+static LexCosts costs;
+
+const LexCosts &lexCosts() {
+    return costs;
+}
+
+void setLexCosts(const LexCosts &c) {
+    costs = c;
+}
+
+const char *lexEngineName(LexEngine e) {
+    static const char *names[ENGINE_COUNT] = { "table", "shuffle", "memoized", "parallel", "lazy", "nfa" };
+    return e >= 0 && e < ENGINE_COUNT ? names[e] : "?";
+}
+
+LexFeatures lexFeatures(const DFAView &lexer, size_t inputBytes, int threads) {
+    LexFeatures f;
+    f.states = lexer.numStates;
+    f.classes = lexer.alphabet;
+    f.accelStates = lexer.numAccel;
+    f.tableBytes = (size_t)lexer.numStates * lexer.alphabet * (lexer.table16 ? 2 : 4);
+    f.sheng = lexer.sheng && shengSupported();
+    f.shengPreferred = f.sheng && shengPreferred(lexer);
+    f.lookahead = lexer.lookahead;
+    f.tags = lexer.numTags;
+    f.inputBytes = inputBytes;
+    f.threads = threads > 0 ? threads : std::max(1, (int)std::thread::hardware_concurrency());
+    return f;
+}
+
+// Predecessors of every NFA state over eps edges, and labeled ones too when
+// labeled is set: those of s are from[start[s] .. start[s+1])
+static void reverseEdges(const FlatNFA &n, bool labeled, std::vector<int> &start, std::vector<int> &from) {
+    auto each = [&n, labeled](auto visit) {
+        for (int s = 0; s < n.numStates; ++s) {
+            for (int e = n.epsStart[s]; e < n.epsStart[s + 1]; ++e) visit(s, n.epsTo[e]);
+            if (labeled)
+                for (int r = n.rangeStart[s]; r < n.rangeStart[s + 1]; ++r) visit(s, n.ranges[r].to);
+        }
+    };
+    start.assign(n.numStates + 2, 0);
+    each([&start](int, int t) { ++start[t + 2]; });
+    for (int s = 0; s < n.numStates; ++s) start[s + 2] += start[s + 1];
+    from.resize(start[n.numStates + 1]);
+    each([&start, &from](int s, int t) { from[start[t + 1]++] = s; });
+    start.pop_back();
+}
+
+// States an accept can be reached from over the edges reverseEdges gave
+static std::vector<char> reachAccept(const FlatNFA &n, const std::vector<int> &start, const std::vector<int> &from) {
+    std::vector<char> reach(n.numStates, 0);
+    std::vector<int> stack;
+    for (int s = 0; s < n.numStates; ++s)
+        if (n.acceptTag[s] >= 0) { reach[s] = 1; stack.push_back(s); }
+    while (!stack.empty()) {
+        int s = stack.back(); stack.pop_back();
+        for (int p = start[s]; p < start[s + 1]; ++p)
+            if (!reach[from[p]]) { reach[from[p]] = 1; stack.push_back(from[p]); }
+    }
+    return reach;
+}
+
+// Lookahead of a spec without determinizing it: 0 when it is bounded, -1 when
+// it may not be. A non-accepting DFA state is a set of NFA states none of
+// which closes to an accept, so an endless walk through such states follows
+// a cycle of NFA states that can still reach an accept but close to none.
+// Eps-only cycles count too, which errs towards unbounded.
+static int specLookahead(const FlatNFA &n) {
+    std::vector<int> start, from;
+    reverseEdges(n, false, start, from);
+    std::vector<char> closes = reachAccept(n, start, from);
+    reverseEdges(n, true, start, from);
+    std::vector<char> live = reachAccept(n, start, from);
+    auto walks = [&](int s) { return live[s] && !closes[s]; };
+    // iterative DFS; color 1 on the stack, 2 done
+    std::vector<char> color(n.numStates, 0);
+    std::vector<std::pair<int,int>> stack;  // (state, next edge: eps ones, then labeled)
+    for (int root = 0; root < n.numStates; ++root) {
+        if (color[root] || !walks(root)) continue;
+        color[root] = 1;
+        stack.push_back({ root, 0 });
+        while (!stack.empty()) {
+            int s = stack.back().first, &k = stack.back().second;
+            int eps = n.epsStart[s + 1] - n.epsStart[s];
+            if (k == eps + n.rangeStart[s + 1] - n.rangeStart[s]) { color[s] = 2; stack.pop_back(); continue; }
+            int t = k < eps ? n.epsTo[n.epsStart[s] + k] : n.ranges[n.rangeStart[s] + k - eps].to;
+            ++k;
+            if (!walks(t)) continue;
+            if (color[t] == 1) return -1;
+            if (color[t] == 0) { color[t] = 1; stack.push_back({ t, 0 }); }
+        }
+    }
+    return 0;
+}
+
+void addSpecFeatures(LexFeatures &f, const NFA &spec) {
+    FlatNFA flat = flattenNFA(spec);
+    SubsetScratch scratch;
+    NFASet start;
+    if (flat.start >= 0) {
+        start.push_back(flat.start);
+        epsClosureInto(flat, start, scratch);
+    }
+    f.nfaStates = (int)spec.states.size();
+    f.nfaStartStates = (int)start.size();
+    if (f.states == 0) {
+        f.tags = nfaTagCount(spec);
+        f.lookahead = specLookahead(flat);
+    }
+}
+
+// Live NFA states of a match, and the lazy DFA's misses over the input
+double lexSetSize(const LexFeatures &f) {
+    return std::max<double>({ 1.0, (double)f.nfaStartStates, f.lazySetSize });
+}
+
+double lexSpecSetupNs(const LexFeatures &f) {
+    return NS_FLATTEN * f.nfaStates;
+}
+
+static double lazyMisses(const LexFeatures &f) {
+    if (f.lazyMissRate >= 0) return f.lazyMissRate * (double)f.inputBytes;
+    return std::min((double)f.inputBytes, f.nfaStates / LAZY_STATES_PER_MISS);
+}
+
+static double missCost(const LexFeatures &f) {
+    return NS_MISS + NS_MISS_STATE * lexSetSize(f);
+}
+
+double lexTableStepNs(const LexFeatures &f) {
+    double step = f.tableBytes <= L1_BYTES ? NS_STEP_L1 : f.tableBytes <= L2_BYTES ? NS_STEP_L2 : NS_STEP_MEM;
+    return f.accelStates > 0 ? step * ACCEL_FACTOR : step;
+}
+
+// Tokenizer loop per byte at the size of the input
+static double loopStep(const LexFeatures &f) {
+    double doublings = std::log2(std::max(1.0, (double)f.inputBytes / LEX_CALIBRATION_BYTES));
+    return costs.loop + costs.loopGrowth * doublings;
+}
+
+// Predicted ns of each engine over the whole input (< 0: cannot run this lexer)
+static void predict(const LexFeatures &f, double ns[ENGINE_COUNT]) {
+    const double n = (double)f.inputBytes;
+    const double loop = loopStep(f);
+    std::fill(ns, ns + ENGINE_COUNT, -1.0);
+    const bool bounded = f.lookahead >= 0;
+    if (f.states > 0) {
+        const double tags = costs.tag * f.tags;
+        if (bounded) ns[ENGINE_TABLE] = n * (loop + lexTableStepNs(f) + tags);
+        if (bounded && f.sheng && f.tags == 0)
+            ns[ENGINE_SHENG] = n * (loop + costs.shengStep);
+        // with unbounded lookahead a scan may run far past its last accept
+        // and every pair it passed is recorded; that is priced as one
+        // record per byte, the worst case the memo is for
+        const double record = bounded ? 0 : costs.memoRecord;
+        ns[ENGINE_MEMO] = n * (loop + lexTableStepNs(f) + tags + costs.memo + record);
+
+        int chunks = std::min<long long>(f.threads * 4LL, (long long)(f.inputBytes / PARALLEL_MIN_CHUNK));
+        if (f.threads > 1 && chunks >= 2) {
+            double seq = -1;
+            for (int e : { ENGINE_TABLE, ENGINE_SHENG, ENGINE_MEMO })
+                if (ns[e] >= 0 && (seq < 0 || ns[e] < seq)) seq = ns[e];
+            double speedup = std::min(f.threads, chunks) * PARALLEL_EFFICIENCY;
+            if (seq >= 0 && speedup > 1) ns[ENGINE_PARALLEL] = seq / speedup + NS_THREAD * (f.threads - 1) + n * NS_MERGE;
+        }
+    }
+    // the lazy DFA and NFA simulation run plain maximal munch and record no tags
+    if (f.nfaStates > 0 && f.tags == 0 && bounded) {
+        double setup = lexSpecSetupNs(f);
+        ns[ENGINE_LAZY] = setup + n * (loop + costs.lazyStep) + lazyMisses(f) * missCost(f);
+        ns[ENGINE_NFA] = setup + n * (loop + costs.nfaState * lexSetSize(f));
+    }
+}
+
+LexPlan planLexer(const LexFeatures &f) {
+    LexPlan plan;
+    plan.features = f;
+    LexFeatures dfa = f;
+    double compileNs = 0;
+    if (f.states == 0 && f.nfaStates > 0) {
+        // not determinized yet: price the table engines as if it were, plus
+        // the construction; the DFA usually has a fraction of the NFA states,
+        // but one whose lazy DFA kept missing is large, and building it costs
+        // about what the lazy misses did
+        compileNs = costs.compile * f.nfaStates;
+        if (f.lazyMissRate >= 0) compileNs += lazyMisses(f) * missCost(f);
+        dfa.states = std::max(1, f.nfaStates / LEX_SPEC_NFA_STATES_PER_STATE);
+        dfa.classes = LEX_SPEC_CLASSES;
+        dfa.tableBytes = (size_t)dfa.states * dfa.classes * 2;
+        dfa.accelStates = 1;
+        dfa.sheng = false;
+    }
+    double ns[ENGINE_COUNT];
+    predict(dfa, ns);
+    int best = -1;
+    for (int e = 0; e < ENGINE_COUNT; ++e) {
+        bool table = e != ENGINE_LAZY && e != ENGINE_NFA;
+        if (ns[e] >= 0 && table) ns[e] += compileNs;
+        plan.costMs[e] = ns[e] < 0 ? -1 : ns[e] / 1e6;
+        if (ns[e] >= 0 && (best < 0 || ns[e] < ns[best])) best = e;
+    }
+    if (best < 0) {
+        // nothing to run (an empty lexer); the table engine reports no tokens
+        plan.reason = "no engine applies";
+        return plan;
+    }
+    plan.engine = (LexEngine)best;
+    plan.compile = compileNs > 0 && best != ENGINE_LAZY && best != ENGINE_NFA;
+    plan.expectedMs = plan.costMs[best];
+    switch (plan.engine) {
+    case ENGINE_TABLE:
+        plan.reason = f.tags > 0 ? "cheapest engine that records the captures"
+                    : plan.compile ? "input large enough to pay for determinizing the spec" : "cheapest step per byte";
+        break;
+    case ENGINE_SHENG:
+        plan.reason = f.shengPreferred ? "small DFA without long self-loop runs" : "small DFA, shuffles beat the table's run scans";
+        break;
+    case ENGINE_MEMO: plan.reason = f.lookahead < 0 ? "unbounded lookahead" : "cheapest step per byte"; break;
+    case ENGINE_PARALLEL: plan.reason = "input large enough to split across threads"; break;
+    case ENGINE_LAZY:
+        plan.reason = f.states > 0 ? "cached transitions cheaper than the compiled table"
+                    : "compiling the spec costs more than the table saves on this input";
+        break;
+    case ENGINE_NFA:
+        plan.reason = f.lazyMissRate >= 0 ? "lazy DFA would keep missing its cache"
+                    : f.states > 0 ? "NFA steps cheaper than the compiled table"
+                    : costs.nfaState * lexSetSize(f) <= costs.lazyStep ? "NFA sets small enough to step faster than the lazy DFA"
+                    : "too few bytes to pay for the lazy DFA's misses";
+        break;
+    default: break;
+    }
+    return plan;
+}
+
+const LexPlan &LexPlanCache::plan(const DFAView &lexer, size_t inputBytes) {
+    int bucket = 0;
+    for (size_t b = inputBytes; b; b >>= 1) ++bucket;
+    if (!m_haveFeatures) {
+        m_features = lexFeatures(lexer, 0);
+        m_haveFeatures = true;
+    }
+    if (!m_planned[bucket]) {
+        LexFeatures f = m_features;
+        f.inputBytes = bucket ? (size_t)1 << (bucket - 1) : 0;
+        m_plans[bucket] = planLexer(f);
+        m_planned[bucket] = true;
+    }
+    return m_plans[bucket];
+}
+
+void LexPlanCache::clear() {
+    m_haveFeatures = false;
+    std::fill(m_planned, m_planned + BUCKETS, false);
+}
@@ -0,0 +1,124 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "dfa.h"
+
+// Matching-engine planner. Every engine produces the same tokens, but they
+// differ in what a byte costs and in what they cost up front, so the best one
+// depends on the lexer (table size, shuffle table, lookahead, tags) and on the
+// input. planLexer predicts the time of each engine that can run the lexer
+// from a small cost model and picks the cheapest; tokenizeWithDFA (given a
+// LexPlanCache) and tokenizeSpec (tokenizer.h) follow the plan. lexbench
+// checks the picks against every engine timed on its corpora.
+enum LexEngine {
+    ENGINE_TABLE,       // dense table, vector scans on self-loop runs (accel.h)
+    ENGINE_SHENG,       // shuffle engine (sheng.h)
+    ENGINE_MEMO,        // memoized maximal munch (MunchMemo in matcher.h)
+    ENGINE_PARALLEL,    // table engine on speculative chunks (tokenizeParallel)
+    ENGINE_LAZY,        // lazy DFA over the token spec (lazydfa.h)
+    ENGINE_NFA,         // NFA simulation of the token spec (nfasim.h)
+    ENGINE_COUNT
+};
+
+const char *lexEngineName(LexEngine e);
+
+// Parallel mode: inputs below this size, or chunks that would get smaller, stay sequential
+const int PARALLEL_MIN_CHUNK = 1 << 16;
+
+// What the planner looks at
+struct LexFeatures {
+    int states = 0;             // compiled lexer; 0 when the spec has not been determinized
+    int classes = 0;
+    int accelStates = 0;        // states with a vector scan on their self-loop (accel.h)
+    size_t tableBytes = 0;      // transition table
+    bool sheng = false;         // shuffle table present and supported by this CPU
+    bool shengPreferred = false; // no wide self-loop the table's vector scan would skip faster
+    int lookahead = 0;          // dfaLookahead; < 0 when unbounded (a spec: not provably bounded)
+    int tags = 0;               // position tags to record (captures)
+    int nfaStates = 0;          // token spec; 0 when it is not available
+    int nfaStartStates = 0;     // closed start set, the typical simulation set size
+    double lazyMissRate = -1;   // from an earlier lazy run on this spec (LazyDFAStats):
+    double lazySetSize = -1;    // misses per byte and NFA states per set; < 0 when unknown
+    size_t inputBytes = 0;
+    int threads = 1;
+};
+
+// Features of a compiled lexer (threads <= 0: one per hardware thread)
+LexFeatures lexFeatures(const DFAView &lexer, size_t inputBytes, int threads = 0);
+
+// Adds the token spec, which makes the lazy DFA and NFA simulation candidates.
+// A spec not compiled yet also gives the tags and whether its lookahead is
+// bounded, so engines it would make quadratic are not considered.
+void addSpecFeatures(LexFeatures &f, const NFA &spec);
+
+// Decision of planLexer, kept as instrumentation
+struct LexPlan {
+    LexEngine engine = ENGINE_TABLE;
+    bool compile = false;           // determinize the spec first (included in expectedMs)
+    double expectedMs = 0;          // predicted time of the pick
+    double costMs[ENGINE_COUNT] = {}; // predicted time per engine, < 0 when it cannot run the lexer
+    double measuredMs = -1;         // wall time of the run, set by tokenizeSpec
+    LexFeatures features;
+    const char *reason = "";
+};
+
+// Cheapest engine for f. Engines that would lose the captures, or take
+// quadratic time on a lexer with unbounded lookahead, are not considered.
+LexPlan planLexer(const LexFeatures &f);
+
+// Plans of one compiled lexer by input size, so the tokenizer does not plan
+// on every call. Sizes are bucketed by powers of two and a bucket is planned
+// once, for its smallest size; the lexer's features are read once too.
+// clear() when the lexer changes.
+class LexPlanCache {
+public:
+    const LexPlan &plan(const DFAView &lexer, size_t inputBytes);
+    void clear();
+
+private:
+    static const int BUCKETS = 65;  // 0, then one per bit length of the size
+    LexFeatures m_features;
+    bool m_haveFeatures = false;
+    LexPlan m_plans[BUCKETS];
+    bool m_planned[BUCKETS] = {};
+};
+
+// Per-byte costs (ns) of the cost model that differ most between machines.
+// The defaults were fitted on an x86-64 desktop; lexbench measures them on
+// the machine it runs on (calibrateLexCosts) and prints them.
+struct LexCosts {
+    double loop = 20;           // tokenizer loop, any engine, on inputs up to 32 KB
+    double loopGrowth = 2;      // added to loop per doubling of a larger input (the tokens outgrow the caches)
+    double shengStep = 1.5;     // one shuffle
+    double tag = 2;             // per recorded tag
+    double memo = 3.5;          // memo lookup and update
+    double memoRecord = 150;    // recording failed pairs, unbounded lookahead only (see predict)
+    double lazyStep = 30;       // cached lazy DFA transition
+    double nfaState = 10;       // per live NFA state
+    double compile = 4500;      // per NFA state, determinizing the spec
+};
+
+// Costs planLexer uses; set them once, before lexing starts
+const LexCosts &lexCosts();
+void setLexCosts(const LexCosts &costs);
+
+// Inputs up to this size pay LexCosts::loop; larger ones add loopGrowth
+const size_t LEX_CALIBRATION_BYTES = 32 << 10;
+
+// Table shape planLexer assumes for a spec not determinized yet, to price
+// the table engines on it. Fitted on the built-in specs: the lexer
+// (buildLexerNFA_thompson) minimizes 3202 NFA states to 472 DFA states over
+// 117 byte classes, the identifier and number specs to 2 and 4 states over
+// 3 classes. So about one DFA state per 8 NFA states, and a class count
+// between the two.
+const int LEX_SPEC_NFA_STATES_PER_STATE = 8;
+const int LEX_SPEC_CLASSES = 64;
+
+// Fixed parts of the model, which lexbench's calibrateLexCosts takes out
+// of what it measures: the table step, the set-up of the lazy DFA and NFA
+// simulation, and the live NFA states of a match
+double lexTableStepNs(const LexFeatures &f);
+double lexSpecSetupNs(const LexFeatures &f);
+double lexSetSize(const LexFeatures &f);
+
+#endif // PLANNER_H
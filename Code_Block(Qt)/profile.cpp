@@ -0,0 +1,135 @@
+#include "profile.h"
+#include "matcher.h"
+#include "utf8.h"
+
+// Matcher sink counting every state entered and the transition into it
+struct ProfileSink {
+    static const bool observes = true;
+    DFAProfile &p;
+    int prev;
+    ProfileSink(DFAProfile &profile, int start) : p(profile), prev(start) {}
+    void state(int s) {
+        ++p.visits[s];
+        ++p.edges[(uint64_t)prev << 32 | (uint32_t)s];
+        prev = s;
+    }
+    void run(int s, int n) {
+        p.visits[s] += (uint64_t)n;
+        p.edges[(uint64_t)s << 32 | (uint32_t)s] += (uint64_t)n;
+        prev = s;
+    }
+};
+
+// Count states and transitions over the corpus, token by token
+DFAProfile profileDFA(const DFAView &d, const std::vector<std::string> &corpus) {
+    DFAProfile p;
+    p.visits.assign(d.numStates, 0);
+    if (d.numStates == 0 || d.start < 0 || d.start >= d.numStates) return p;
+    for (const std::string &text : corpus) {
+        const int n = (int)text.size();
+        for (int i = 0; i < n;) {
+            if (isWhitespace(text[i])) { ++i; continue; }
+            ++p.visits[d.start];
+            ++p.tokens;
+            ProfileSink sink(p, d.start);
+            int acceptState = -1;
+            int len = matchLongest(d, text, i, sink, &acceptState);
+            i += len ? len : utf8SequenceLength((const unsigned char *)text.data() + i, (size_t)(n - i));
+        }
+    }
+    return p;
+}
+
+// Hot chains first, then the states the corpus never reached
+std::vector<int> profileOrder(const DFA &d, const DFAProfile &p) {
+    const int n = d.numStates;
+    // successors of every state, hottest first
+    std::vector<std::vector<std::pair<uint64_t, int>>> succ(n);
+    for (const auto &e : p.edges) {
+        int from = (int)(e.first >> 32), to = (int)(uint32_t)e.first;
+        if (from != to) succ[from].push_back({ e.second, to });
+    }
+    for (auto &s : succ)
+        std::sort(s.begin(), s.end(), [](const std::pair<uint64_t, int> &a, const std::pair<uint64_t, int> &b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+    std::vector<int> hot;
+    for (int s = 0; s < n; ++s) if (p.visits[s] > 0) hot.push_back(s);
+    std::stable_sort(hot.begin(), hot.end(), [&p](int a, int b) { return p.visits[a] > p.visits[b]; });
+
+    std::vector<int> order;
+    std::vector<char> placed(n, 0);
+    for (int head : hot) {
+        for (int s = head; s >= 0;) {
+            if (placed[s]) break;
+            placed[s] = 1;
+            order.push_back(s);
+            int nextState = -1;
+            for (const auto &e : succ[s]) if (!placed[e.second]) { nextState = e.second; break; }
+            s = nextState;
+        }
+    }
+    for (int s = 0; s < n; ++s) if (!placed[s]) order.push_back(s);
+    return order;
+}
+
+// Apply a permutation of the states to every per-state table
+void renumberDFA(DFA &d, const std::vector<int> &order) {
+    const int n = d.numStates;
+    const size_t k = (size_t)d.alphabet;
+    std::vector<int> newId(n);
+    for (int i = 0; i < n; ++i) newId[order[i]] = i;
+
+    std::vector<int32_t> table;
+    std::vector<uint16_t> table16;
+    if (!d.table16.empty()) table16.resize(d.table16.size());
+    else table.resize(d.table.size());
+    std::vector<uint64_t> acceptBits(d.acceptBits.size(), 0);
+    std::vector<int> acceptTag(n, -1);
+    for (int i = 0; i < n; ++i) {
+        int old = order[i];
+        for (size_t c = 0; c < k; ++c) {
+            int t = d.step(old, (int)c);
+            if (!table16.empty()) table16[i * k + c] = t == DFA_DEAD ? DFA_DEAD16 : (uint16_t)newId[t];
+            else table[i * k + c] = t == DFA_DEAD ? DFA_DEAD : newId[t];
+        }
+        if (d.isAccept(old)) acceptBits[i >> 6] |= 1ull << (i & 63);
+        acceptTag[i] = d.acceptTag[old];
+    }
+    d.table.swap(table);
+    d.table16.swap(table16);
+    d.acceptBits.swap(acceptBits);
+    d.acceptTag.swap(acceptTag);
+    d.start = newId[d.start];
+    if (d.numTags > 0) {
+        std::vector<uint32_t> tagSet(n), tagUse(n);
+        for (int i = 0; i < n; ++i) { tagSet[i] = d.tagSet[order[i]]; tagUse[i] = d.tagUse[order[i]]; }
+        d.tagSet.swap(tagSet);
+        d.tagUse.swap(tagUse);
+    }
+    if ((int)d.rev.size() == n) {
+        std::vector<NFASet> rev(n);
+        for (int i = 0; i < n; ++i) rev[i] = std::move(d.rev[order[i]]);
+        d.rev.swap(rev);
+    }
+    if ((int)d.origin.size() == n) {
+        std::vector<std::vector<int>> origin(n);
+        for (int i = 0; i < n; ++i) origin[i] = std::move(d.origin[order[i]]);
+        d.origin.swap(origin);
+    }
+    if (d.packedRev.size() == n) d.packedRev.reorder(order);
+    if (d.packedOrigin.size() == n) d.packedOrigin.reorder(order);
+    packDFA(d);
+}
+
+bool profileLayoutPays(const DFA &d) {
+    return d.table.size() * sizeof(int32_t) + d.table16.size() * sizeof(uint16_t) >= PROFILE_LAYOUT_MIN_BYTES;
+}
+
+void applyProfileLayout(DFA &d, const std::vector<std::string> &corpus) {
+    DFAProfile p = profileDFA(d.view(), corpus);
+    renumberDFA(d, profileOrder(d, p));
+    d.hotStates = 0;
+    for (uint64_t v : p.visits) d.hotStates += v > 0;
+}
@@ -0,0 +1,47 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "dfa.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Profile-guided state layout. States are numbered in BFS discovery order,
+// which has nothing to do with how often the lexer touches them; running it
+// over a training corpus and renumbering the hot states (and the rows they
+// own) into one contiguous block keeps the hot part of the table in as few
+// cache lines as possible. States the corpus never reached go after all
+// visited ones, so their rows form a separate cold region at the end.
+
+// Visit and transition counts of one profiling run
+struct DFAProfile {
+    std::vector<uint64_t> visits;                   // state -> times entered (the start once per token)
+    std::unordered_map<uint64_t, uint64_t> edges;   // (from << 32 | to) -> times taken
+    uint64_t tokens = 0;
+};
+
+// Tokenize every text of corpus the way tokenizeWithDFA does and count
+// which states and transitions the matcher uses
+DFAProfile profileDFA(const DFAView &d, const std::vector<std::string> &corpus);
+
+// New numbering: chains that follow the hottest transition out of each state,
+// started from the hottest state not yet placed, then the unvisited states in
+// their old order. order[newId] = old id.
+std::vector<int> profileOrder(const DFA &d, const DFAProfile &p);
+
+// Renumber d so old state order[k] becomes k. Provenance moves with the states;
+// accel and shuffle tables are rebuilt by packDFA.
+void renumberDFA(DFA &d, const std::vector<int> &order);
+
+// Profile d on corpus and renumber it hot-first; d.hotStates is set to the
+// number of states the corpus visited (rows [hotStates, numStates) are cold)
+void applyProfileLayout(DFA &d, const std::vector<std::string> &corpus);
+
+// A table smaller than this stays in cache whatever its order, so the layout
+// buys nothing (lexbench: the lexer's table gains nothing, the 31 MB keyword one does)
+const size_t PROFILE_LAYOUT_MIN_BYTES = 1 << 20;
+
+// Whether d's table is large enough for applyProfileLayout to pay
+bool profileLayoutPays(const DFA &d);
+
+#endif // PROFILE_H
@@ -0,0 +1,98 @@
+#include "provenance.h"
+#include "dfa.h"
+
+static void putVarint(std::vector<uint8_t> &out, uint32_t v) {
+    while (v >= 0x80) { out.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+    out.push_back((uint8_t)v);
+}
+
+void NFASetArena::assign(const std::vector<std::vector<int>> &sets) {
+    clear();
+    offsets.reserve(sets.size() + 1);
+    offsets.push_back(0);
+    for (const std::vector<int> &set : sets) {
+        int prev = 0;
+        for (size_t k = 0; k < set.size(); ++k) {
+            putVarint(bytes, (uint32_t)(k ? set[k] - prev : set[k]));
+            prev = set[k];
+        }
+        offsets.push_back((uint32_t)bytes.size());
+    }
+}
+
+bool decodeNFASet(const uint8_t *p, const uint8_t *end, std::vector<int> &out) {
+    out.clear();
+    uint32_t id = 0;
+    while (p < end) {
+        uint32_t v = 0;
+        for (int shift = 0;; shift += 7) {
+            if (p == end || shift > 28) return false;
+            uint8_t b = *p++;
+            v |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+        id = out.empty() ? v : id + v;
+        if (id > (uint32_t)INT32_MAX) return false;
+        out.push_back((int)id);
+    }
+    return true;
+}
+
+bool NFASetArena::get(int i, std::vector<int> &out) const {
+    if (i < 0 || i >= size() || offsets[i] > offsets[i + 1] || offsets[i + 1] > bytes.size()) return false;
+    return decodeNFASet(bytes.data() + offsets[i], bytes.data() + offsets[i + 1], out);
+}
+
+void NFASetArena::reorder(const std::vector<int> &order) {
+    NFASetArena r;
+    r.offsets.reserve(order.size() + 1);
+    r.offsets.push_back(0);
+    r.bytes.reserve(bytes.size());
+    for (int old : order) {
+        r.bytes.insert(r.bytes.end(), bytes.begin() + offsets[old], bytes.begin() + offsets[old + 1]);
+        r.offsets.push_back((uint32_t)r.bytes.size());
+    }
+    *this = std::move(r);
+}
+
+void setProvenance(DFA &d, ProvenanceMode mode) {
+    if (mode == PROVENANCE_FULL) return;
+    if (mode == PROVENANCE_PACKED) {
+        if (!d.rev.empty()) d.packedRev.assign(d.rev);
+        if (!d.origin.empty()) d.packedOrigin.assign(d.origin);
+        if (!d.originRev.empty()) d.packedOriginRev.assign(d.originRev);
+    } else {
+        d.packedRev.clear();
+        d.packedOrigin.clear();
+        d.packedOriginRev.clear();
+    }
+    std::vector<NFASet>().swap(d.rev);
+    std::vector<std::vector<int>>().swap(d.origin);
+    std::vector<NFASet>().swap(d.originRev);
+}
+
+bool dfaStateSet(const DFA &d, int s, std::vector<int> &out) {
+    if (s >= 0 && s < (int)d.rev.size()) { out = d.rev[s]; return true; }
+    return d.packedRev.get(s, out);
+}
+
+bool dfaStateOrigin(const DFA &d, int s, std::vector<int> &out) {
+    if (s >= 0 && s < (int)d.origin.size()) { out = d.origin[s]; return true; }
+    return d.packedOrigin.get(s, out);
+}
+
+bool dfaOriginSet(const DFA &d, int q, std::vector<int> &out) {
+    if (q >= 0 && q < (int)d.originRev.size()) { out = d.originRev[q]; return true; }
+    return d.packedOriginRev.get(q, out);
+}
+
+static size_t setsBytes(const std::vector<std::vector<int>> &sets) {
+    size_t n = sets.capacity() * sizeof(std::vector<int>);
+    for (const std::vector<int> &s : sets) n += s.capacity() * sizeof(int);
+    return n;
+}
+
+size_t provenanceBytes(const DFA &d) {
+    return setsBytes(d.rev) + setsBytes(d.origin) + setsBytes(d.originRev)
+           + d.packedRev.footprint() + d.packedOrigin.footprint() + d.packedOriginRev.footprint();
+}
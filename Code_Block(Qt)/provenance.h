@@ -0,0 +1,54 @@
+#ifndef PROVENANCE_H
+#define PROVENANCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct DFA;
+
+// NFA-set provenance: which NFA states every DFA state stands for. The
+// construction stages need it (position tags, incremental determinization,
+// minimization), but at run time only the visualizer reads it, and as one
+// vector per state it is several times larger than the transition table.
+
+// Many sorted NFA sets in one arena: set i is bytes [offsets[i], offsets[i+1])
+// holding LEB128 varints, the first id and then the gaps between consecutive
+// ids. Lexer sets are mostly runs of nearby ids, so a gap is usually one byte.
+struct NFASetArena {
+    std::vector<uint32_t> offsets;
+    std::vector<uint8_t> bytes;
+
+    int size() const { return offsets.empty() ? 0 : (int)offsets.size() - 1; }
+    size_t footprint() const { return offsets.size() * sizeof(uint32_t) + bytes.size(); }
+    void assign(const std::vector<std::vector<int>> &sets);
+    bool get(int i, std::vector<int> &out) const;
+    void reorder(const std::vector<int> &order);    // set i becomes old set order[i]
+    void clear() { offsets.clear(); bytes.clear(); }
+};
+
+// Decode one set of arena bytes [p, end); false when they are malformed
+bool decodeNFASet(const uint8_t *p, const uint8_t *end, std::vector<int> &out);
+
+// What a finished DFA keeps of its provenance (rev, origin, originRev)
+enum ProvenanceMode {
+    PROVENANCE_FULL,        // vectors as the construction left them
+    PROVENANCE_PACKED,      // moved into arenas, decoded one state at a time
+    PROVENANCE_NONE         // dropped
+};
+
+// Pack or drop d's provenance (PROVENANCE_FULL leaves it as it is). Only for
+// finished DFAs: computeTags and subsetConstructionIncremental need rev.
+void setProvenance(DFA &d, ProvenanceMode mode);
+
+// NFA set of state s, from rev or the packed arena; false when there is none
+bool dfaStateSet(const DFA &d, int s, std::vector<int> &out);
+
+// Pre-minimization ids merged into state s, and the NFA set of one of them
+bool dfaStateOrigin(const DFA &d, int s, std::vector<int> &out);
+bool dfaOriginSet(const DFA &d, int q, std::vector<int> &out);
+
+// Bytes held by d's provenance in whichever form it has
+size_t provenanceBytes(const DFA &d);
+
+#endif // PROVENANCE_H
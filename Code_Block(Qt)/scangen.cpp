@@ -0,0 +1,105 @@
+#include "scangen.h"
+#include <cstdio>
+#include <sstream>
+
+// Maximal byte run sharing one target (DFA_DEAD leaves the scanner)
+struct ByteSegment { int lo, hi, to; };
+
+static std::string hexByte(int b) {
+    char buf[8];
+    std::snprintf(buf, sizeof(buf), "0x%02x", b);
+    return buf;
+}
+
+static std::string gotoTarget(int to) {
+    return to == DFA_DEAD ? "goto done;" : "goto s" + std::to_string(to) + ";";
+}
+
+// Binary search over segments [first, last]; short tails become a compare chain
+static void emitDispatch(std::ostringstream &out, const std::vector<ByteSegment> &segs,
+                         int first, int last, const std::string &indent) {
+    if (last - first < 3) {
+        for (int i = first; i < last; ++i)
+            out << indent << "if (c <= " << hexByte(segs[i].hi) << ") " << gotoTarget(segs[i].to) << "\n";
+        out << indent << gotoTarget(segs[last].to) << "\n";
+        return;
+    }
+    int mid = (first + last + 1) / 2;
+    out << indent << "if (c < " << hexByte(segs[mid].lo) << ") {\n";
+    emitDispatch(out, segs, first, mid - 1, indent + "    ");
+    out << indent << "}\n";
+    emitDispatch(out, segs, mid, last, indent);
+}
+
+std::string generateDirectScanner(const DFA &d, const std::string &funcName, uint64_t specHash) {
+    std::ostringstream out;
+    char hash[32];
+    std::snprintf(hash, sizeof(hash), "0x%016llxull", (unsigned long long)specHash);
+    out << "// Generated by scangen from the lexer spec. Do not edit.\n"
+        << "// " << d.numStates << " states, " << d.alphabet << " byte classes.\n"
+        << "#include \"direct_scanner.h\"\n\n"
+        << "const uint64_t directScannerSpecHash = " << hash << ";\n"
+        << "const int directScannerNumTags = " << d.numTags << ";\n\n"
+        << "int " << funcName << "(const std::string &s, int pos, int *tag, int *" << (d.numTags ? "tagPos" : "") << ")\n{\n"
+        << "    const unsigned char *const base = (const unsigned char *)s.data() + pos;\n"
+        << "    const unsigned char *const end = (const unsigned char *)s.data() + s.size();\n"
+        << "    const unsigned char *p = base, *mark = base;\n"
+        << "    int acc = -1;\n"
+        << "    unsigned c;\n";
+    // tag registers, the start state's set to pos; tagPos starts out unset
+    for (int t = 0; t < d.numTags; ++t)
+        out << "    int r" << t << " = " << ((d.tagSet[d.start] >> t) & 1 ? "pos" : "-1") << ";\n";
+    if (d.numTags) {
+        out << "    if (tagPos)";
+        for (int t = 0; t < d.numTags; ++t) out << " tagPos[" << t << "] =";
+        out << " -1;\n";
+    }
+
+    // only emit labels that some transition jumps to, so the output has no unused labels
+    std::vector<char> entered(d.numStates, 0);
+    for (int s = 0; s < d.numStates; ++s)
+        for (int b = 0; b < 256; ++b) {
+            int t = d.next(s, (unsigned char)b);
+            if (t != DFA_DEAD) entered[t] = 1;
+        }
+
+    // the start state comes first so the function falls into it
+    std::vector<int> order;
+    if (d.numStates > 0) order.push_back(d.start);
+    for (int s = 0; s < d.numStates; ++s) if (s != d.start) order.push_back(s);
+
+    for (int s : order) {
+        // matching nothing is not a token: the start's accept only counts when re-entered
+        bool bookkeeping = d.isAccept(s) && entered[s];
+        if (s == d.start && bookkeeping) out << "    goto s" << s << "_in;\n";
+        if (entered[s]) out << "s" << s << ":\n";
+        for (int t = 0; entered[s] && t < d.numTags; ++t)
+            if ((d.tagSet[s] >> t) & 1) out << "    r" << t << " = pos + (int)(p - base);\n";
+        if (bookkeeping) out << "    mark = p; acc = " << d.acceptTag[s] << ";\n";
+        if (bookkeeping && d.numTags) {
+            // every accept reports all tags, so those the winning token lacks end up -1
+            out << "    if (tagPos) {";
+            for (int t = 0; t < d.numTags; ++t)
+                out << " tagPos[" << t << "] = " << ((d.tagUse[s] >> t) & 1 ? "r" + std::to_string(t) : "-1") << ";";
+            out << " }\n";
+        }
+        if (s == d.start && bookkeeping) out << "s" << s << "_in:\n";
+
+        std::vector<ByteSegment> segs;
+        for (int b = 0; b < 256; ++b) {
+            int t = d.next(s, (unsigned char)b);
+            if (!segs.empty() && segs.back().to == t) segs.back().hi = b;
+            else segs.push_back({ b, b, t });
+        }
+        if (segs.size() == 1 && segs[0].to == DFA_DEAD) { out << "    goto done;\n"; continue; }
+        out << "    if (p == end) goto done;\n"
+            << "    c = *p++;\n";
+        emitDispatch(out, segs, 0, (int)segs.size() - 1, "    ");
+    }
+
+    out << "done:\n"
+        << "    if (tag) *tag = acc;\n"
+        << "    return (int)(mark - base);\n"
+        << "}\n";
+    return out.str();
+}
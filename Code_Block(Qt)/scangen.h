@@ -0,0 +1,18 @@
+#ifndef SCANGEN_H
+#define SCANGEN_H
+
+#include "dfa.h"
+#include <string>
+
+// Emit a direct-coded (re2c-style) scanner for d as C++ source: one label per
+// state, a binary search of range comparisons on the byte instead of a table
+// lookup, and accept bookkeeping only in accepting states. The generated
+// function has the contract of dfaLongestMatchCaptures:
+//   int funcName(const std::string &s, int pos, int *tag, int *tagPos);
+// A tagged d (tagdfa.h) keeps one local per tag, set on entering the states
+// that set it; tagPos may be null when the caller wants no captures.
+// specHash is emitted as directScannerSpecHash and d.numTags as
+// directScannerNumTags (see direct_scanner.h).
+std::string generateDirectScanner(const DFA &d, const std::string &funcName, uint64_t specHash);
+
+#endif // SCANGEN_H
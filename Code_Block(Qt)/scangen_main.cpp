@@ -0,0 +1,26 @@
+#include "scangen.h"
+#include "lexspec.h"
+#include "dfaio.h"
+#include <cstdio>
+#include <fstream>
+
+// Build-time tool: writes the direct-coded lexer for the current token spec.
+// Usage: scangen <output.cpp>
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::fprintf(stderr, "usage: %s <output.cpp>\n", argv[0]);
+        return 2;
+    }
+    NFA spec = buildLexerNFA_thompson();
+    // the app's lexer, position tags included, so the scanner reports the same captures
+    DFA lexer = compileLexerDFA(spec);
+    std::string src = generateDirectScanner(lexer, "directLongestMatch", hashNFASpec(spec));
+
+    std::ofstream out(argv[1], std::ios::binary | std::ios::trunc);
+    out << src;
+    if (!out) {
+        std::fprintf(stderr, "scangen: cannot write %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
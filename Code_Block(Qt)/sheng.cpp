@@ -0,0 +1,115 @@
+#include "sheng.h"
+#include "dfa.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SHENG_X86 1
+#include <immintrin.h>
+#endif
+
+bool shengPreferred(const DFAView &d) {
+    if (d.numStates > SHENG_MAX_STATES || d.numStates == 0) return false;
+    for (int s = 0; s < d.numStates; ++s) {
+        if (d.accelIndex[s] < 0) continue;
+        const ByteRanges &r = d.accel[d.accelIndex[s]];
+        int width = 0;
+        for (int k = 0; k < r.count; ++k) width += r.hi[k] - r.lo[k] + 1;
+        if (width >= SHENG_WIDE_LOOP) return false;
+    }
+    return true;
+}
+
+void buildShengTable(const DFAView &d, std::vector<uint8_t> &out) {
+    out.clear();
+    if (d.numStates > SHENG_MAX_STATES || d.numStates == 0) return;
+    const int dead = d.numStates;
+    out.assign(257 * 16, (uint8_t)dead);
+    for (int b = 0; b < 256; ++b) {
+        uint8_t *mask = &out[(size_t)b * 16];
+        for (int s = 0; s < d.numStates; ++s) {
+            size_t cell = (size_t)s * d.alphabet + d.classOf[b];
+            int t = d.table16 ? (d.table16[cell] == DFA_DEAD16 ? DFA_DEAD : d.table16[cell]) : d.table[cell];
+            mask[s] = (uint8_t)(t == DFA_DEAD ? dead : t);
+        }
+    }
+    uint8_t *accept = &out[256 * 16];
+    for (int s = 0; s < 16; ++s) accept[s] = s < d.numStates && d.isAccept(s) ? 0x80 : 0;
+}
+
+// Same automaton one byte at a time, for short inputs, tails and CPUs without SSSE3
+static int shengRunScalar(const uint8_t *sheng, int cur, int dead, const unsigned char *p, int n,
+                          int *last, int *lastState) {
+    const uint8_t *accept = sheng + 256 * 16;
+    for (int i = 0; i < n; ++i) {
+        cur = sheng[(size_t)p[i] * 16 + cur];
+        if (cur == dead) return dead;
+        if (accept[cur]) { *last = i; *lastState = cur; }
+    }
+    return cur;
+}
+
+#ifdef SHENG_X86
+// 8 bytes per block: the state history is collected with palignr, then the
+// accept and dead lanes of the whole block are read with one movemask each.
+// (16-byte blocks waste more steps after a short token has ended.)
+__attribute__((target("ssse3")))
+static int shengRunSSSE3(const uint8_t *sheng, int start, int dead, const unsigned char *p, int n,
+                         int *last, int *lastState) {
+    const __m128i *masks = (const __m128i *)sheng;
+    const __m128i acceptVec = _mm_loadu_si128(masks + 256);
+    const __m128i deadVec = _mm_set1_epi8((char)dead);
+    __m128i state = _mm_set1_epi8((char)start);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i hist = _mm_setzero_si128();
+#define SHENG_STEP(k) \
+        state = _mm_shuffle_epi8(_mm_loadu_si128(masks + p[i + k]), state); \
+        hist = _mm_alignr_epi8(state, hist, 1);
+        SHENG_STEP(0)  SHENG_STEP(1)  SHENG_STEP(2)  SHENG_STEP(3)
+        SHENG_STEP(4)  SHENG_STEP(5)  SHENG_STEP(6)  SHENG_STEP(7)
+#undef SHENG_STEP
+        unsigned acc = (unsigned)_mm_movemask_epi8(_mm_shuffle_epi8(acceptVec, hist)) >> 8;
+        unsigned died = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(hist, deadVec)) >> 8;
+        if (died) acc &= (1u << __builtin_ctz(died)) - 1;
+        if (acc) {
+            alignas(16) uint8_t lanes[16];
+            _mm_store_si128((__m128i *)lanes, hist);
+            int k = 31 - __builtin_clz(acc);
+            *last = i + k;
+            *lastState = lanes[8 + k];
+        }
+        if (died) return dead;
+    }
+    int cur = _mm_cvtsi128_si32(state) & 0xFF;
+    int tailLast = -1;
+    cur = shengRunScalar(sheng, cur, dead, p + i, n - i, &tailLast, lastState);
+    if (tailLast >= 0) *last = i + tailLast;
+    return cur;
+}
+#endif
+
+static bool detectSheng() {
+#ifdef SHENG_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#else
+    return false;
+#endif
+}
+
+static const bool g_shengSupported = detectSheng();
+
+bool shengSupported() { return g_shengSupported; }
+
+int shengLongestMatch(const DFAView &d, const std::string &s, int pos, int *acceptState) {
+    const unsigned char *p = (const unsigned char *)s.data() + pos;
+    const int n = (int)s.size() - pos;
+    int last = -1, lastState = -1;
+#ifdef SHENG_X86
+    if (g_shengSupported && n >= 8)
+        shengRunSSSE3(d.sheng, d.start, d.numStates, p, n, &last, &lastState);
+    else
+#endif
+        shengRunScalar(d.sheng, d.start, d.numStates, p, n, &last, &lastState);
+    *acceptState = lastState;
+    return last + 1;
+}
@@ -0,0 +1,36 @@
+#ifndef SHENG_H
+#define SHENG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct DFAView;
+
+// Shuffle ("Sheng") engine for small DFAs. A state is a byte in an SSE
+// register and every input byte b has a 16-byte mask with mask[s] = next(s, b),
+// so one pshufb per byte advances the state with no dependent table load.
+// The dead state becomes a self-looping state of its own, so a DFA may have
+// at most SHENG_MAX_STATES live states.
+const int SHENG_MAX_STATES = 15;
+
+// A state that loops on at least this many byte values tends to see long
+// runs, which the table engine skips with its vector scan (accel.h) faster
+// than one shuffle per byte
+const int SHENG_WIDE_LOOP = 32;
+
+// Engine choice: true when d is small enough and has no wide self-loop
+bool shengPreferred(const DFAView &d);
+
+// Table layout: 256 masks of 16 bytes, then a 16-byte vector with 0x80 at
+// every accepting state. out is left empty when d has too many states.
+void buildShengTable(const DFAView &d, std::vector<uint8_t> &out);
+
+// True when the CPU has the shuffle instructions (SSSE3)
+bool shengSupported();
+
+// Longest match from pos with the shuffle engine (d.sheng must be set); the
+// state of the last accept goes to *acceptState (-1 when nothing matched)
+int shengLongestMatch(const DFAView &d, const std::string &s, int pos, int *acceptState);
+
+#endif // SHENG_H
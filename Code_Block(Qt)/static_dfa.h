@@ -0,0 +1,367 @@
+#ifndef STATIC_DFA_H
+#define STATIC_DFA_H
+
+#include "dfa.h"
+#include <cstdint>
+#include <string>
+
+// Compile-time construction of the fixed built-in token classes. The same
+// pipeline as the runtime one (Thompson fragments, subset construction,
+// minimization) runs in constexpr functions over fixed-capacity arrays, and
+// the results land in static constexpr tables. NFA sets are 64-bit masks, so
+// a spec may use at most CT_MAX_NFA states; overflowing any capacity is a
+// compile error, since the out-of-range write is not a constant expression.
+const int CT_MAX_NFA = 64;
+const int CT_MAX_EDGES = 64;
+const int CT_MAX_DFA = 32;
+const int CT_MAX_CLASSES = 16;
+
+struct CtByteSet {
+    uint64_t w[4] = {};
+
+    constexpr bool test(int b) const { return (w[b >> 6] >> (b & 63)) & 1; }
+    constexpr void set(int b) { w[b >> 6] |= 1ull << (b & 63); }
+    constexpr void setRange(int a, int b) { for (int c = a; c <= b; ++c) set(c); }
+};
+
+// Thompson NFA: labeled edges carry a byte set, epsilon edges none
+struct CtNFA {
+    int numStates = 0;
+    int start = -1;
+    int accept = -1;
+    int numEdges = 0;
+    int from[CT_MAX_EDGES] = {};
+    int to[CT_MAX_EDGES] = {};
+    CtByteSet label[CT_MAX_EDGES] = {};
+    int numEps = 0;
+    int epsFrom[CT_MAX_EDGES] = {};
+    int epsTo[CT_MAX_EDGES] = {};
+
+    constexpr int newState() { return numStates++; }
+    constexpr void addEdge(int f, const CtByteSet &l, int t) { from[numEdges] = f; to[numEdges] = t; label[numEdges] = l; ++numEdges; }
+    constexpr void addEps(int f, int t) { epsFrom[numEps] = f; epsTo[numEps] = t; ++numEps; }
+};
+
+// Fragment helpers mirror nfa.cpp state for state, so NFA ids (and with them
+// the provenance shown by the visualizer) match the runtime construction
+constexpr Fragment ctCharClass(CtNFA &n, const CtByteSet &allowed) {
+    int s = n.newState();
+    int t = n.newState();
+    n.addEdge(s, allowed, t);
+    return {s, t};
+}
+
+constexpr Fragment ctChar(CtNFA &n, char c) {
+    CtByteSet l;
+    l.set((unsigned char)c);
+    return ctCharClass(n, l);
+}
+
+constexpr Fragment ctConcat(CtNFA &n, const Fragment &a, const Fragment &b) {
+    n.addEps(a.accept, b.start);
+    return {a.start, b.accept};
+}
+
+constexpr Fragment ctAlt(CtNFA &n, const Fragment &a, const Fragment &b) {
+    int s = n.newState();
+    int t = n.newState();
+    n.addEps(s, a.start);
+    n.addEps(s, b.start);
+    n.addEps(a.accept, t);
+    n.addEps(b.accept, t);
+    return {s, t};
+}
+
+constexpr Fragment ctStar(CtNFA &n, const Fragment &a) {
+    int s = n.newState();
+    int t = n.newState();
+    n.addEps(s, a.start);
+    n.addEps(s, t);
+    n.addEps(a.accept, a.start);
+    n.addEps(a.accept, t);
+    return {s, t};
+}
+
+// position tags only matter to tagged DFAs; here they are the plain eps pair
+constexpr Fragment ctTag(CtNFA &n) {
+    int s = n.newState();
+    int t = n.newState();
+    n.addEps(s, t);
+    return {s, t};
+}
+
+constexpr Fragment ctCapture(CtNFA &n, const Fragment &a) {
+    Fragment open = ctTag(n);
+    Fragment inner = ctConcat(n, open, a);
+    return ctConcat(n, inner, ctTag(n));
+}
+
+constexpr Fragment ctOpt(CtNFA &n, const Fragment &a) {
+    int s = n.newState();
+    int t = n.newState();
+    n.addEps(s, a.start);
+    n.addEps(s, t);
+    n.addEps(a.accept, t);
+    return {s, t};
+}
+
+// identifier: [a-zA-Z_][a-zA-Z0-9_]*  (see buildIdentifierNFA_thompson)
+constexpr CtNFA ctIdentifierNFA() {
+    CtNFA n;
+    CtByteSet letters;
+    letters.setRange('a', 'z'); letters.setRange('A', 'Z');
+    letters.set('_');
+    Fragment f1 = ctCharClass(n, letters);
+    CtByteSet idchars = letters;
+    idchars.setRange('0', '9');
+    Fragment f2 = ctCharClass(n, idchars);
+    Fragment full = ctConcat(n, f1, ctStar(n, f2));
+    n.start = full.start;
+    n.accept = full.accept;
+    return n;
+}
+
+// number: digits+ then ('.' digits+)?  (see buildNumberNFA_thompson)
+constexpr CtNFA ctNumberNFA() {
+    CtNFA n;
+    CtByteSet digits;
+    digits.setRange('0', '9');
+    Fragment intDigit = ctCharClass(n, digits);
+    Fragment intDigits = ctConcat(n, intDigit, ctStar(n, intDigit));
+    Fragment intPart = ctCapture(n, intDigits);
+    Fragment dot = ctChar(n, '.');
+    Fragment fracDigit = ctCharClass(n, digits);
+    Fragment fracDigits = ctConcat(n, fracDigit, ctStar(n, fracDigit));
+    Fragment frac = ctConcat(n, dot, ctCapture(n, fracDigits));
+    Fragment fracOpt = ctOpt(n, frac);
+    Fragment full = ctConcat(n, intPart, fracOpt);
+    n.start = full.start;
+    n.accept = full.accept;
+    return n;
+}
+
+// Fixed-capacity DFA between the compile-time stages. After ctMinimize,
+// origin[i] is the mask of merged pre-minimization ids and originRev keeps
+// their NFA sets, as DFA::origin / DFA::originRev do at runtime.
+struct CtDFA {
+    int numStates = 0;
+    int alphabet = 0;
+    int start = 0;
+    int nfaStates = 0;
+    int statesBefore = 0;
+    uint8_t classOf[256] = {};
+    int table[CT_MAX_DFA][CT_MAX_CLASSES] = {}; // next state or DFA_DEAD
+    bool accept[CT_MAX_DFA] = {};
+    uint64_t rev[CT_MAX_DFA] = {};
+    uint32_t origin[CT_MAX_DFA] = {};
+    uint64_t originRev[CT_MAX_DFA] = {};
+};
+
+constexpr uint64_t ctClosure(const CtNFA &n, uint64_t set) {
+    for (uint64_t prev = 0; prev != set;) {
+        prev = set;
+        for (int e = 0; e < n.numEps; ++e)
+            if ((set >> n.epsFrom[e]) & 1) set |= 1ull << n.epsTo[e];
+    }
+    return set;
+}
+
+// Byte classes and subset construction. Classes are numbered by their
+// smallest byte and states in discovery order, as computeByteClasses and
+// subsetConstruction do.
+constexpr CtDFA ctSubset(const CtNFA &n) {
+    CtDFA d;
+    d.nfaStates = n.numStates;
+    int classRep[CT_MAX_CLASSES] = {};
+    for (int b = 0; b < 256; ++b) {
+        int cls = -1;
+        for (int c = 0; c < d.alphabet && cls < 0; ++c) {
+            bool same = true;
+            for (int e = 0; e < n.numEdges && same; ++e)
+                same = n.label[e].test(b) == n.label[e].test(classRep[c]);
+            if (same) cls = c;
+        }
+        if (cls < 0) { cls = d.alphabet++; classRep[cls] = b; }
+        d.classOf[b] = (uint8_t)cls;
+    }
+
+    d.rev[0] = ctClosure(n, 1ull << n.start);
+    d.numStates = 1;
+    for (int i = 0; i < d.numStates; ++i) {
+        d.accept[i] = (d.rev[i] >> n.accept) & 1;
+        for (int c = 0; c < d.alphabet; ++c) {
+            uint64_t moved = 0;
+            for (int e = 0; e < n.numEdges; ++e)
+                if (((d.rev[i] >> n.from[e]) & 1) && n.label[e].test(classRep[c])) moved |= 1ull << n.to[e];
+            d.table[i][c] = DFA_DEAD;
+            if (!moved) continue;
+            moved = ctClosure(n, moved);
+            int id = 0;
+            while (id < d.numStates && d.rev[id] != moved) ++id;
+            if (id == d.numStates) d.rev[d.numStates++] = moved;
+            d.table[i][c] = id;
+        }
+    }
+    d.statesBefore = d.numStates;
+    return d;
+}
+
+// Moore partition refinement, then BFS renumbering from the start block;
+// states equivalent to the implicit dead state are dropped (as minimizeDFA)
+constexpr CtDFA ctMinimize(const CtDFA &d) {
+    const int dead = d.numStates;
+    int blk[CT_MAX_DFA + 1] = {};
+    int next[CT_MAX_DFA + 1] = {};
+    for (int q = 0; q < d.numStates; ++q) blk[q] = d.accept[q] ? 1 : 0;
+    blk[dead] = 0;
+    for (bool changed = true; changed;) {
+        int count = 0;
+        for (int q = 0; q <= dead; ++q) {
+            next[q] = -1;
+            for (int p = 0; p < q && next[q] < 0; ++p) {
+                bool same = blk[p] == blk[q];
+                for (int c = 0; c < d.alphabet && same; ++c) {
+                    int tp = p == dead || d.table[p][c] == DFA_DEAD ? dead : d.table[p][c];
+                    int tq = q == dead || d.table[q][c] == DFA_DEAD ? dead : d.table[q][c];
+                    same = blk[tp] == blk[tq];
+                }
+                if (same) next[q] = next[p];
+            }
+            if (next[q] < 0) next[q] = count++;
+        }
+        changed = false;
+        for (int q = 0; q <= dead; ++q) { changed = changed || next[q] != blk[q]; blk[q] = next[q]; }
+        // block ids are first-occurrence ordered, so a stable partition maps onto itself
+    }
+
+    CtDFA m;
+    m.nfaStates = d.nfaStates;
+    m.statesBefore = d.numStates;
+    m.alphabet = d.alphabet;
+    for (int b = 0; b < 256; ++b) m.classOf[b] = d.classOf[b];
+    for (int q = 0; q < d.numStates; ++q) m.originRev[q] = d.rev[q];
+
+    int newId[CT_MAX_DFA + 1] = {};
+    int order[CT_MAX_DFA] = {};
+    for (int b = 0; b <= dead; ++b) newId[b] = DFA_DEAD;
+    if (blk[d.start] != blk[dead]) { newId[blk[d.start]] = 0; order[m.numStates++] = d.start; }
+    for (int idx = 0; idx < m.numStates; ++idx) {
+        int rep = order[idx];
+        for (int c = 0; c < d.alphabet; ++c) {
+            int t = d.table[rep][c];
+            if (t == DFA_DEAD || blk[t] == blk[dead] || newId[blk[t]] != DFA_DEAD) continue;
+            newId[blk[t]] = m.numStates;
+            order[m.numStates++] = t;
+        }
+    }
+    for (int id = 0; id < m.numStates; ++id) {
+        int rep = order[id];
+        for (int q = 0; q < d.numStates; ++q) {
+            if (blk[q] != blk[rep]) continue;
+            m.origin[id] |= 1u << q;
+            m.rev[id] |= d.rev[q];
+        }
+        m.accept[id] = d.accept[rep];
+        for (int c = 0; c < d.alphabet; ++c) {
+            int t = d.table[rep][c];
+            m.table[id][c] = t == DFA_DEAD || blk[t] == blk[dead] ? DFA_DEAD : newId[blk[t]];
+        }
+    }
+    if (m.numStates == 0) m.numStates = 1; // empty language keeps a lone start state
+    return m;
+}
+
+// Exact-size table for one token class; S states over C byte classes
+template <int S, int C>
+struct StaticDFA {
+    static_assert(S > 0 && S < 128 && C > 0, "static DFA cells are int8_t");
+    static constexpr int numStates = S;
+    static constexpr int alphabet = C;
+    int start = 0;
+    int nfaStates = 0;
+    int statesBefore = 0;
+    uint8_t classOf[256] = {};
+    int8_t table[S][C] = {};    // next state or DFA_DEAD
+    bool accept[S] = {};
+    uint64_t rev[S] = {};       // provenance masks, see CtDFA
+    uint32_t origin[S] = {};
+    uint64_t originRev[CT_MAX_DFA] = {};
+};
+
+template <int S, int C>
+constexpr StaticDFA<S, C> ctPack(const CtDFA &m) {
+    StaticDFA<S, C> t;
+    t.start = m.start;
+    t.nfaStates = m.nfaStates;
+    t.statesBefore = m.statesBefore;
+    for (int b = 0; b < 256; ++b) t.classOf[b] = m.classOf[b];
+    for (int s = 0; s < S; ++s) {
+        for (int c = 0; c < C; ++c) t.table[s][c] = (int8_t)m.table[s][c];
+        t.accept[s] = m.accept[s];
+        t.rev[s] = m.rev[s];
+        t.origin[s] = m.origin[s];
+    }
+    for (int q = 0; q < m.statesBefore; ++q) t.originRev[q] = m.originRev[q];
+    return t;
+}
+
+// The built-in tables, evaluated entirely by the compiler; inline, so every
+// translation unit shares one copy (and one address for staticLongestMatch)
+inline constexpr CtDFA ctIdentifierMin = ctMinimize(ctSubset(ctIdentifierNFA()));
+inline constexpr CtDFA ctNumberMin = ctMinimize(ctSubset(ctNumberNFA()));
+inline constexpr StaticDFA<ctIdentifierMin.numStates, ctIdentifierMin.alphabet> identifierTable =
+    ctPack<ctIdentifierMin.numStates, ctIdentifierMin.alphabet>(ctIdentifierMin);
+inline constexpr StaticDFA<ctNumberMin.numStates, ctNumberMin.alphabet> numberTable =
+    ctPack<ctNumberMin.numStates, ctNumberMin.alphabet>(ctNumberMin);
+
+// Longest match specialized on one table: the table is a template argument,
+// so its size and contents are constants the optimizer can fold and unroll
+template <const auto &T>
+inline int staticLongestMatch(const std::string &s, int pos) {
+    const unsigned char *p = (const unsigned char *)s.data();
+    const int n = (int)s.size();
+    int cur = T.start, len = 0;
+    for (int i = pos; i < n; ++i) {
+        int nxt = T.table[cur][T.classOf[p[i]]];
+        if (nxt == DFA_DEAD) break;
+        cur = nxt;
+        if (T.accept[cur]) len = i - pos + 1;
+    }
+    return len;
+}
+
+inline NFASet nfaSetFromMask(uint64_t mask) {
+    NFASet out;
+    for (int i = 0; i < 64; ++i) if ((mask >> i) & 1) out.push_back(i);
+    return out;
+}
+
+// Runtime DFA with the same tables and provenance, for the visualizer and the
+// trace matcher; no determinization happens at startup
+template <int S, int C>
+DFA staticToDFA(const StaticDFA<S, C> &t) {
+    DFA d;
+    d.numStates = S;
+    d.alphabet = C;
+    d.start = t.start;
+    for (int b = 0; b < 256; ++b) d.classOf[b] = t.classOf[b];
+    d.table.assign((size_t)S * C, DFA_DEAD);
+    d.acceptBits.assign((S + 63) / 64, 0);
+    d.acceptTag.assign(S, -1);
+    d.rev.resize(S);
+    d.origin.resize(S);
+    for (int s = 0; s < S; ++s) {
+        for (int c = 0; c < C; ++c) d.table[(size_t)s * C + c] = t.table[s][c];
+        if (t.accept[s]) { d.acceptBits[s >> 6] |= 1ull << (s & 63); d.acceptTag[s] = 0; }
+        d.rev[s] = nfaSetFromMask(t.rev[s]);
+        for (int q = 0; q < 32; ++q) if ((t.origin[s] >> q) & 1) d.origin[s].push_back(q);
+    }
+    for (int q = 0; q < t.statesBefore; ++q) d.originRev.push_back(nfaSetFromMask(t.originRev[q]));
+    d.stats.nfaStates = t.nfaStates;
+    d.stats.statesBefore = t.statesBefore;
+    d.stats.statesAfter = S;
+    packDFA(d);
+    return d;
+}
+
+#endif // STATIC_DFA_H
@@ -0,0 +1,120 @@
+#include "tagdfa.h"
+
+static void setError(std::string *error, const std::string &msg) {
+    if (error) *error = msg;
+}
+
+static void clearTags(DFA &d) {
+    d.numTags = 0;
+    d.tagSet.clear();
+    d.tagUse.clear();
+}
+
+bool computeTags(const NFA &n, DFA &d, std::string *error) {
+    clearTags(d);
+    FlatNFA f = flattenNFA(n);
+    const int N = f.numStates, T = f.numTags;
+    if (T == 0) return true;
+    if (T > MAX_TAGS) { setError(error, "too many position tags"); return false; }
+    if ((int)d.rev.size() != d.numStates) { setError(error, "DFA has no NFA sets"); return false; }
+    auto bit = [&f](int q) { return f.tagOf[q] >= 0 ? 1u << f.tagOf[q] : 0u; };
+
+    // successors over eps and labeled edges, and the reverse lists
+    std::vector<std::vector<int>> succ(N), pred(N);
+    for (int q = 0; q < N; ++q) {
+        for (int e = f.epsStart[q]; e < f.epsStart[q + 1]; ++e) succ[q].push_back(f.epsTo[e]);
+        for (int r = f.rangeStart[q]; r < f.rangeStart[q + 1]; ++r) succ[q].push_back(f.ranges[r].to);
+        for (int t : succ[q]) pred[t].push_back(q);
+    }
+
+    // passed[q]: tags on some path from the start to q
+    std::vector<uint32_t> passed(N, 0);
+    std::vector<char> seen(N, 0);
+    std::vector<int> stack;
+    if (f.start >= 0) { seen[f.start] = 1; passed[f.start] = bit(f.start); stack.push_back(f.start); }
+    while (!stack.empty()) {
+        int q = stack.back(); stack.pop_back();
+        for (int t : succ[q]) {
+            uint32_t m = passed[q] | bit(t);
+            if (seen[t] && !(m & ~passed[t])) continue;
+            seen[t] = 1;
+            passed[t] |= m;
+            stack.push_back(t);
+        }
+    }
+
+    // live[t][q]: from q, an accept whose token has tag t is reachable without
+    // passing t again, so a thread in q still needs t's current value
+    std::vector<std::vector<char>> live(T, std::vector<char>(N, 0));
+    for (int t = 0; t < T; ++t) {
+        std::vector<char> &lv = live[t];
+        for (int a = 0; a < N; ++a) {
+            if (f.acceptTag[a] < 0 || !((passed[a] >> t) & 1) || f.tagOf[a] == t) continue;
+            lv[a] = 1;
+            stack.push_back(a);
+        }
+        while (!stack.empty()) {
+            int q = stack.back(); stack.pop_back();
+            for (int p : pred[q]) {
+                if (lv[p] || f.tagOf[p] == t) continue;
+                lv[p] = 1;
+                stack.push_back(p);
+            }
+        }
+    }
+
+    // a transition that sets t is exact when every thread it leads to without
+    // passing t (eps walk from the moved set around the t states) no longer
+    // needs t; returns the first tag that fails, -1 if none
+    std::vector<uint32_t> mark(N, 0);
+    uint32_t gen = 0;
+    auto conflict = [&](const NFASet &seeds, uint32_t tags) {
+        for (int t = 0; t < T; ++t) {
+            if (!((tags >> t) & 1)) continue;
+            ++gen;
+            for (int q : seeds) {
+                if (f.tagOf[q] == t || mark[q] == gen) continue;
+                mark[q] = gen;
+                stack.push_back(q);
+            }
+            while (!stack.empty()) {
+                int q = stack.back(); stack.pop_back();
+                if (live[t][q]) { stack.clear(); return t; }
+                for (int e = f.epsStart[q]; e < f.epsStart[q + 1]; ++e) {
+                    int r = f.epsTo[e];
+                    if (f.tagOf[r] == t || mark[r] == gen) continue;
+                    mark[r] = gen;
+                    stack.push_back(r);
+                }
+            }
+        }
+        return -1;
+    };
+
+    std::vector<uint32_t> tagSet(d.numStates, 0), tagUse(d.numStates, 0);
+    for (int s = 0; s < d.numStates; ++s) {
+        for (int q : d.rev[s]) {
+            tagSet[s] |= bit(q);
+            if (f.acceptTag[q] >= 0 && f.acceptTag[q] == d.acceptTag[s]) tagUse[s] |= passed[q];
+        }
+    }
+    SubsetScratch scratch;
+    NFASet moved;
+    int bad = tagSet[d.start] ? conflict(NFASet(1, f.start), tagSet[d.start]) : -1;
+    for (int s = 0; s < d.numStates && bad < 0; ++s) {
+        for (int c = 0; c < d.alphabet && bad < 0; ++c) {
+            int t = d.step(s, c);
+            if (t == DFA_DEAD || !tagSet[t]) continue;
+            moveOnClassInto(f, d.rev[s], c, moved, scratch);
+            bad = conflict(moved, tagSet[t]);
+        }
+    }
+    if (bad >= 0) {
+        setError(error, "position tag " + std::to_string(bad) + " needs more than one register");
+        return false;
+    }
+    d.numTags = T;
+    d.tagSet.swap(tagSet);
+    d.tagUse.swap(tagUse);
+    return true;
+}
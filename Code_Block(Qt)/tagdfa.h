@@ -0,0 +1,25 @@
+#ifndef TAGDFA_H
+#define TAGDFA_H
+
+#include "dfa.h"
+#include <string>
+
+// Tagged DFA: sub-token captures recorded during the one longest-match scan
+// (after Laurikari, "NFAs with Tagged Transitions", SPIRE 2000). Position
+// tags sit on eps-only NFA states (makeTag, captureFrag in nfa.h). A DFA
+// state is an NFA set closed under eps, and the tag states in it are exactly
+// the ones its incoming transitions passed, so entering the state sets those
+// tags to the current position (DFA::tagSet). That needs one register per
+// tag and no register copies, which is exact as long as no NFA thread still
+// needs a tag's old value when another thread overwrites it; computeTags
+// checks this and rejects specs that would need more registers, rather than
+// report wrong positions. Tag 2k opens capture k, tag 2k+1 closes it.
+
+// Fill d.numTags, d.tagSet and d.tagUse from the tags of n. d must come
+// straight out of subsetConstruction or subsetConstructionParallel over n
+// (d.rev holds each state's NFA set); minimizeDFA and renumberDFA keep the
+// tags from there on. False, with d left untagged, when the tags do not fit
+// one register each.
+bool computeTags(const NFA &n, DFA &d, std::string *error = nullptr);
+
+#endif // TAGDFA_H
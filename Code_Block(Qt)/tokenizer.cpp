@@ -1,69 +1,409 @@
 #include "tokenizer.h"
+#include "matcher.h"
+#include "utf8.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#ifdef CODEBLOCK_DIRECT_SCANNER
+#include "direct_scanner.h"
+#endif
 
-static std::set<std::string> keywords = {
-    "int","float","if","else","while","for","break","continue","return"
+// Blanks that only advance the column (' ', '\t', '\v', '\f'), skipped a run at a time
+static ByteRanges makeBlankRanges() {
+    bool member[256] = {};
+    member[(unsigned char)' '] = member[(unsigned char)'\t'] = true;
+    member[(unsigned char)'\v'] = member[(unsigned char)'\f'] = true;
+    ByteRanges r;
+    makeByteRanges(member, r);
+    return r;
+}
+static const ByteRanges blanks = makeBlankRanges();
+
+// Loop state between two tokens. colReset is set once a newline or CR has
+// been passed, i.e. once col no longer counts from where the run started;
+// relative counts the tokens emitted before that.
+struct LexCursor {
+    int pos = 0, line = 1, col = 1;
+    bool colReset = false;
+    int relative = 0;
 };
-static std::set<char> operators = {
-    '+','-','*','/','=','<','>','!','&','|','%'
+
+// Skips whitespace from cur while cur.pos < stop, updating line/col.
+// True when a token starts at cur.pos, false once stop is reached.
+static inline bool skipWhitespace(const std::string &input, LexCursor &cur, int stop)
+{
+    const int n = (int)input.size();
+    while (cur.pos < stop) {
+        char c = input[cur.pos];
+        if (!isWhitespace(c)) return true;
+        if (c == '\n') { ++cur.line; cur.col = 1; cur.colReset = true; ++cur.pos; continue; }
+        if (c == '\r') { ++cur.pos; /* ignore CR alone, or will be followed by LF */ cur.col = 1; cur.colReset = true; continue; }
+        int run = (int)scanRun(blanks, (const unsigned char *)input.data() + cur.pos, (size_t)(n - cur.pos));
+        cur.pos += run; cur.col += run;
+    }
+    return false;
+}
+
+// Appends the token the matcher found at cur.pos (len 0: Unknown) and moves past it.
+// Matching runs on bytes; columns count code points, so only the bytes of a
+// finished token are looked at again (continuation bytes add no column).
+static inline void emitToken(const std::string &input, LexCursor &cur, int len, int tag,
+                             std::vector<TokenItem> &out)
+{
+    const int n = (int)input.size();
+    if (!cur.colReset) ++cur.relative;
+    if (len == 0) {
+        // one Unknown token per code point (or per malformed byte)
+        int cp = utf8SequenceLength((const unsigned char *)input.data() + cur.pos, (size_t)(n - cur.pos));
+        out.push_back({ "Unknown", input.substr(cur.pos, cp), cur.line, cur.col, {} });
+        cur.pos += cp; ++cur.col;
+        return;
+    }
+    out.push_back({ tokenKindName(tag), input.substr(cur.pos, len), cur.line, cur.col, {} });
+    // update pos, line/col (tokens here should not contain newlines, but guard anyway)
+    for (int k = 0; k < len; ++k, ++cur.pos) {
+        if (input[cur.pos] == '\n') { ++cur.line; cur.col = 1; cur.colReset = true; }
+        else cur.col += !isUtf8Continuation((unsigned char)input[cur.pos]);
+    }
+}
+
+// Matcher on a tagged lexer: keeps the tag positions of its last match
+struct CaptureMatch {
+    const DFAView *lexer;
+    int tagPos[MAX_TAGS];
+    int operator()(const std::string &s, int pos, int *tag) {
+        return dfaLongestMatchCaptures(*lexer, s, pos, tag, tagPos);
+    }
+    explicit CaptureMatch(const DFAView &v) : lexer(&v) {}
 };
-static std::set<char> delimiters = {
-    '(',')','{','}','[',']',',',';',':'
+
+// Turns tag positions (an open/close pair per group) into token captures
+static inline void addTagCaptures(int numTags, const int *tagPos, int start, TokenItem &tok)
+{
+    const int count = numTags / 2;
+    for (int k = 0; k < count; ++k) {
+        int open = tagPos[2 * k], close = tagPos[2 * k + 1];
+        if (open < 0 || close < open) continue;
+        if ((int)tok.captures.size() <= k) tok.captures.resize(count);
+        tok.captures[k] = { open - start, close - open };
+    }
+}
+
+// Captures of the token just emitted; other matchers record none
+template <typename Match>
+static inline void addCaptures(Match &, int, TokenItem &) {}
+
+static inline void addCaptures(CaptureMatch &m, int start, TokenItem &tok)
+{
+    addTagCaptures(m.lexer->numTags, m.tagPos, start, tok);
+}
+
+#ifdef CODEBLOCK_DIRECT_SCANNER
+// The generated scanner, keeping the tag positions of its last match
+struct DirectMatch {
+    int tagPos[MAX_TAGS];
+    int operator()(const std::string &s, int pos, int *tag) {
+        return directLongestMatch(s, pos, tag, tagPos);
+    }
 };
 
-// Tokenize while tracking line and column (1-based), returns vector<TokenItem with line/col)
-std::vector<TokenItem> tokenizeWithDFA(const std::string &input,
-                                       const DFA &dfaId,
-                                       const DFA &dfaNum)
+static inline void addCaptures(DirectMatch &m, int start, TokenItem &tok)
+{
+    addTagCaptures(directScannerNumTags, m.tagPos, start, tok);
+}
+#endif
+
+// Tokenizer loop shared by all matchers. match(input, pos, &tag) returns the
+// longest-match length at pos and sets tag to the winning TokenKind.
+// Lexes from cur until the loop reaches a position >= stop (a token may
+// extend past stop) and leaves cur there.
+template <typename Match>
+static void lexRange(const std::string &input, Match &match, LexCursor &cur, int stop,
+                     std::vector<TokenItem> &out)
+{
+    LexCursor c = cur;
+    while (skipWhitespace(input, c, stop)) {
+        // one maximal-munch pass; the accept tag says which token kind won
+        int tag = -1, start = c.pos;
+        int len = match(input, c.pos, &tag);
+        emitToken(input, c, len, tag, out);
+        if (len > 0) addCaptures(match, start, out.back());
+    }
+    cur = c;
+}
+
+template <typename Match>
+static std::vector<TokenItem> tokenizeImpl(const std::string &input, Match match)
 {
     std::vector<TokenItem> out;
-    int i = 0, n = (int)input.size();
-    int line = 1, col = 1;
-    while (i < n) {
-        char c = input[i];
-        if (isWhitespace(c)) {
-            // update line/col for whitespace
-            if (c == '\n') { ++line; col = 1; ++i; continue; }
-            if (c == '\r') { ++i; /* ignore CR alone, or will be followed by LF */ col = 1; continue; }
-            ++i; ++col; continue;
-        }
+    LexCursor cur;
+    lexRange(input, match, cur, (int)input.size(), out);
+    return out;
+}
 
-        // start position
-        int startLine = line, startCol = col;
+// One chunk of the parallel mode, lexed with line/col counted from its start
+struct LexChunk {
+    int begin = 0, end = 0;      // speculative start, start of the next chunk
+    LexCursor last;              // where the loop left the chunk
+    std::vector<TokenItem> tokens;
+};
 
-        if (operators.count(c)) {
-            out.push_back({ "Operator", std::string(1,c), startLine, startCol });
-            ++i; ++col; continue;
+// First position in [p, limit) that follows a whitespace byte and is not
+// whitespace itself: the sequential loop always stops there, because no token
+// contains whitespace. limit if there is none.
+static int resyncPoint(const std::string &input, int p, int limit) {
+    for (; p < limit; ++p)
+        if (p > 0 && isWhitespace(input[p - 1]) && !isWhitespace(input[p])) return p;
+    return limit;
+}
+
+// Speculative chunked tokenizer: chunks start at resync points and are lexed
+// in parallel; a chunk is only kept when the lexer of the previous chunk
+// really stopped at its start, otherwise it is lexed again from there. Line
+// and column are fixed up afterwards from the running (line, col) at every
+// chunk start, so the result equals tokenizeImpl.
+template <typename Match>
+static std::vector<TokenItem> tokenizeParallelImpl(const std::string &input, Match match, int threads)
+{
+    const int n = (int)input.size();
+    if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+    int wanted = std::min(threads * 4, n / PARALLEL_MIN_CHUNK);
+    if (threads == 1 || wanted < 2) return tokenizeImpl(input, match);
+
+    std::vector<LexChunk> chunks;
+    for (int k = 0, begin = 0; k < wanted && begin < n; ++k) {
+        int limit = (int)((long long)n * (k + 2) / wanted);
+        int next = k + 1 == wanted ? n : resyncPoint(input, (int)((long long)n * (k + 1) / wanted), limit);
+        if (next <= begin || (next == limit && k + 1 < wanted)) continue; // no resync point: merge with the next chunk
+        chunks.push_back(LexChunk());
+        chunks.back().begin = begin;
+        chunks.back().end = next;
+        begin = next;
+    }
+
+    auto runChunks = [&](auto body) {
+        std::atomic<size_t> next{0};
+        auto work = [&]() {
+            for (size_t k; (k = next.fetch_add(1)) < chunks.size();) body(chunks[k]);
+        };
+        std::vector<std::thread> pool;
+        for (int t = 1; t < threads; ++t) pool.emplace_back(work);
+        work();
+        for (std::thread &th : pool) th.join();
+    };
+
+    // speculative pass
+    runChunks([&](LexChunk &ch) {
+        Match m = match;
+        ch.last.pos = ch.begin;
+        lexRange(input, m, ch.last, ch.end, ch.tokens);
+    });
+
+    // validate in order; a chunk whose start the previous one did not stop at is lexed again
+    int reached = 0;
+    for (LexChunk &ch : chunks) {
+        if (ch.begin != reached) {
+            ch.begin = reached;
+            ch.last = LexCursor();
+            ch.last.pos = reached;
+            ch.tokens.clear();
+            lexRange(input, match, ch.last, ch.end, ch.tokens);
         }
-        if (delimiters.count(c)) {
-            out.push_back({ "Delimiter", std::string(1,c), startLine, startCol });
-            ++i; ++col; continue;
+        reached = ch.last.pos;
+    }
+
+    // running (line, col) at every chunk start, then place the tokens
+    std::vector<size_t> firstToken(chunks.size() + 1, 0);
+    std::vector<LexCursor> base(chunks.size());
+    for (size_t k = 0; k < chunks.size(); ++k) {
+        firstToken[k + 1] = firstToken[k] + chunks[k].tokens.size();
+        if (k == 0) continue;
+        const LexCursor &prev = base[k - 1], &last = chunks[k - 1].last;
+        base[k].line = prev.line + last.line - 1;
+        base[k].col = last.colReset ? last.col : prev.col + last.col - 1;
+    }
+    std::vector<TokenItem> out(firstToken.back());
+    runChunks([&](LexChunk &ch) {
+        size_t k = &ch - chunks.data();
+        TokenItem *dst = out.data() + firstToken[k];
+        for (size_t t = 0; t < ch.tokens.size(); ++t) {
+            TokenItem &tok = ch.tokens[t];
+            tok.line += base[k].line - 1;
+            if ((int)t < ch.last.relative) tok.col += base[k].col - 1;
+            dst[t] = std::move(tok);
         }
+        std::vector<TokenItem>().swap(ch.tokens);
+    });
+    return out;
+}
 
-        int lenId = dfaLongestMatch(dfaId, input, i);
-        int lenNum = dfaLongestMatch(dfaNum, input, i);
-
-        if (lenId == 0 && lenNum == 0) {
-            out.push_back({ "Unknown", std::string(1,c), startLine, startCol });
-            ++i; ++col;
-        } else {
-            if (lenId >= lenNum) {
-                std::string tok = input.substr(i, lenId);
-                std::string type = keywords.count(tok) ? "Keyword" : "Identifier";
-                out.push_back({ type, tok, startLine, startCol });
-                // update i, line/col (tokens here should not contain newlines, but guard anyway)
-                for (int k = 0; k < lenId; ++k) {
-                    if (input[i] == '\n') { ++line; col = 1; ++i; }
-                    else { ++i; ++col; }
-                }
-            } else {
-                std::string tok = input.substr(i, lenNum);
-                out.push_back({ "Number", tok, startLine, startCol });
-                for (int k = 0; k < lenNum; ++k) {
-                    if (input[i] == '\n') { ++line; col = 1; ++i; }
-                    else { ++i; ++col; }
+// Tokenize while tracking line and column (1-based), returns vector<TokenItem with line/col)
+std::vector<TokenItem> tokenizeWithDFA(const std::string &input, const DFA &lexer)
+{
+    return tokenizeWithDFA(input, lexer.view());
+}
+
+// Matcher carrying a Reps memo; each parallel chunk lexes with its own copy.
+// On a tagged lexer it keeps the tag positions of its last match too.
+struct MemoMatch {
+    const DFAView *lexer;
+    MunchMemo memo;
+    int tagPos[MAX_TAGS];
+    int operator()(const std::string &s, int pos, int *tag) {
+        *tag = -1;
+        if (lexer->numStates == 0 || lexer->start < 0 || lexer->start >= lexer->numStates) return 0;
+        int acceptState = -1;
+        int len = memoLongestMatch(*lexer, s, pos, memo, &acceptState, lexer->numTags > 0 ? tagPos : nullptr);
+        if (acceptState >= 0) *tag = lexer->acceptTag[acceptState];
+        return len;
+    }
+    explicit MemoMatch(const DFAView &v) : lexer(&v) {}
+};
+
+static inline void addCaptures(MemoMatch &m, int start, TokenItem &tok)
+{
+    addTagCaptures(m.lexer->numTags, m.tagPos, start, tok);
+}
+
+static double msSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Same, over tables that may be mapped from a file, with the planned engine
+std::vector<TokenItem> tokenizeWithDFA(const std::string &input, const DFAView &lexer, LexPlanCache *plans)
+{
+    LexEngine engine = lexer.sheng ? ENGINE_SHENG : ENGINE_TABLE;
+    if (plans) engine = plans->plan(lexer, input.size()).engine;
+    return tokenizeWithEngine(input, lexer, engine);
+}
+
+// Same, with the engine given
+std::vector<TokenItem> tokenizeWithEngine(const std::string &input, const DFAView &lexer, LexEngine engine)
+{
+    if (engine == ENGINE_PARALLEL) return tokenizeParallel(input, lexer);
+    if (engine == ENGINE_MEMO || lexer.lookahead < 0) return tokenizeMemoized(input, lexer);
+    if (lexer.numTags > 0) return tokenizeImpl(input, CaptureMatch(lexer));
+    DFAView v = lexer;
+    if (engine != ENGINE_SHENG) v.sheng = nullptr;
+    return tokenizeImpl(input, [&v](const std::string &s, int pos, int *tag) {
+        return dfaLongestMatchTagged(v, s, pos, tag);
+    });
+}
+
+// Same, from the token spec, compiling it only when the plan says so
+std::vector<TokenItem> tokenizeSpec(const std::string &input, const NFA &spec, DFA &compiled, LexPlan *plan)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    LexFeatures f = lexFeatures(compiled.numStates > 0 ? compiled.view() : DFAView(), input.size());
+    addSpecFeatures(f, spec);
+    LexPlan chosen = planLexer(f);
+    std::vector<TokenItem> out;
+    if (chosen.engine == ENGINE_LAZY) {
+        LazyDFA lazy(spec);
+        out = tokenizeWithDFA(input, lazy);
+    } else if (chosen.engine == ENGINE_NFA) {
+        NFASimulator sim(spec);
+        out = tokenizeWithNFA(input, sim);
+    } else {
+        if (compiled.numStates == 0) compiled = compileLexerDFA(spec);
+        out = tokenizeWithEngine(input, compiled.view(), chosen.engine);
+    }
+    chosen.measuredMs = msSince(t0);
+    if (plan) *plan = chosen;
+    return out;
+}
+
+// Same, always with memoized maximal munch
+std::vector<TokenItem> tokenizeMemoized(const std::string &input, const DFAView &lexer)
+{
+    return tokenizeImpl(input, MemoMatch(lexer));
+}
+
+// Same, on several threads (threads <= 0: one per hardware thread)
+std::vector<TokenItem> tokenizeParallel(const std::string &input, const DFAView &lexer, int threads)
+{
+    if (lexer.lookahead < 0) return tokenizeParallelImpl(input, MemoMatch(lexer), threads);
+    if (lexer.numTags > 0) return tokenizeParallelImpl(input, CaptureMatch(lexer), threads);
+    return tokenizeParallelImpl(input, [&lexer](const std::string &s, int pos, int *tag) {
+        return dfaLongestMatchTagged(lexer, s, pos, tag);
+    }, threads);
+}
+
+// Many inputs, up to MATCH_BATCH_MAX at a time: every lane of matchStreams
+// lexes one input, and a lane whose input runs out takes the next one from
+// the list, so the lanes stay busy until the list is done. On a tagged lexer
+// each lane also keeps its tag positions, so tokens get the same captures as
+// when lexed one by one.
+std::vector<std::vector<TokenItem>> tokenizeBatch(const std::vector<std::string> &inputs,
+                                                  const DFAView &lexer, int streams)
+{
+    std::vector<std::vector<TokenItem>> out(inputs.size());
+    if (lexer.numStates == 0 || lexer.start < 0 || lexer.start >= lexer.numStates
+        || (lexer.sheng && shengSupported()) || lexer.lookahead < 0) {
+        for (size_t k = 0; k < inputs.size(); ++k) out[k] = tokenizeWithDFA(inputs[k], lexer);
+        return out;
+    }
+    streams = std::max(1, std::min(streams, MATCH_BATCH_MAX));
+    int input[MATCH_BATCH_MAX];
+    LexCursor cur[MATCH_BATCH_MAX];
+    MatchStream batch[MATCH_BATCH_MAX];
+    int tagPos[MATCH_BATCH_MAX][MAX_TAGS];
+    if (lexer.numTags > 0)
+        for (int k = 0; k < streams; ++k) batch[k].tagPos = tagPos[k];
+    size_t next = 0;
+
+    // point lane k at its next token, taking new inputs as old ones run out
+    auto advance = [&](int k) {
+        for (;;) {
+            if (input[k] >= 0) {
+                const std::string &in = inputs[input[k]];
+                if (skipWhitespace(in, cur[k], (int)in.size())) {
+                    batch[k].input = &in;
+                    batch[k].pos = cur[k].pos;
+                    return true;
                 }
             }
+            if (next >= inputs.size()) return false;
+            input[k] = (int)next++;
+            cur[k] = LexCursor();
         }
+    };
+    int count = 0;
+    while (count < streams) {
+        input[count] = -1;
+        if (!advance(count)) break;
+        ++count;
     }
+    matchStreams(lexer, batch, count, [&](int k, MatchStream &m) {
+        std::vector<TokenItem> &tokens = out[input[k]];
+        emitToken(inputs[input[k]], cur[k], m.len, m.tag, tokens);
+        if (m.len > 0 && m.tagPos) addTagCaptures(lexer.numTags, m.tagPos, m.pos, tokens.back());
+        return advance(k);
+    });
     return out;
 }
+
+// Same, determinizing the lexer lazily as the input needs it
+std::vector<TokenItem> tokenizeWithDFA(const std::string &input, LazyDFA &lexer)
+{
+    return tokenizeImpl(input, [&lexer](const std::string &s, int pos, int *tag) {
+        return lexer.longestMatch(s, pos, tag);
+    });
+}
+
+// Same, with the NFA simulated state set by state set
+std::vector<TokenItem> tokenizeWithNFA(const std::string &input, NFASimulator &lexer)
+{
+    return tokenizeImpl(input, [&lexer](const std::string &s, int pos, int *tag) {
+        return lexer.longestMatch(s, pos, tag);
+    });
+}
+
+#ifdef CODEBLOCK_DIRECT_SCANNER
+// Same, with the generated scanner as the matcher
+std::vector<TokenItem> tokenizeDirect(const std::string &input)
+{
+    return tokenizeImpl(input, DirectMatch());
+}
+#endif
@@ -2,16 +2,84 @@
 #define TOKENIZER_H
 
 #include "dfa.h"
+#include "lexspec.h"
+#include "lazydfa.h"
+#include "nfasim.h"
+#include "planner.h"
 #include <string>
 #include <vector>
-#include <set>
 
-// TokenItem now includes line+column
-struct TokenItem { std::string type, text; int line, col; };
+// Sub-span of a token's text from a capture in its token spec (bytes into
+// text); begin is -1 when the capture did not take part in the match
+struct TokenCapture { int begin = -1, length = 0; };
 
-// Tokenize while tracking line and column (1-based), returns vector<TokenItem with line/col)
-std::vector<TokenItem> tokenizeWithDFA(const std::string &input,
-                                       const DFA &dfaId,
-                                       const DFA &dfaNum);
+// TokenItem now includes line+column. captures is indexed by capture id
+// (e.g. NUMBER_INT, NUMBER_FRAC) and empty for tokens without captures.
+struct TokenItem {
+    std::string type, text;
+    int line, col;
+    std::vector<TokenCapture> captures;
+};
+
+// Tokenize while tracking line and column (1-based), returns vector<TokenItem with line/col).
+// Input is UTF-8 and columns count code points.
+// lexer is the combined DFA from buildLexerDFA(); its accept tags are TokenKinds.
+std::vector<TokenItem> tokenizeWithDFA(const std::string &input, const DFA &lexer);
+
+// Same, over tables that may be mapped from a file (see dfaio.h).
+// Tagged lexers (tagdfa.h) fill TokenItem::captures in the same scan, with
+// every engine that runs a compiled lexer.
+// Lexers with unbounded lookahead (dfaLookahead) are run with memoized
+// maximal munch, so tokenizing takes linear time for any token spec; that
+// matcher keeps the tags too.
+// With plans, the engine is the one planLexer (planner.h) picked for this
+// lexer and the input's size bucket; plans must belong to lexer. Without,
+// it is the lexer's own: the shuffle engine when packDFA built a shuffle
+// table, otherwise the table engine.
+std::vector<TokenItem> tokenizeWithDFA(const std::string &input, const DFAView &lexer,
+                                       LexPlanCache *plans = nullptr);
+
+// Same, with the engine given (ENGINE_TABLE, ENGINE_SHENG, ENGINE_MEMO or
+// ENGINE_PARALLEL; the others need the token spec, see tokenizeSpec). An
+// engine that cannot run the lexer falls back to the table engine.
+std::vector<TokenItem> tokenizeWithEngine(const std::string &input, const DFAView &lexer, LexEngine engine);
+
+// Same, from the token spec: compiled is used when it has states; otherwise
+// planLexer weighs determinizing spec (into compiled, kept for later calls)
+// against a lazy DFA or NFA simulation for this one input
+std::vector<TokenItem> tokenizeSpec(const std::string &input, const NFA &spec, DFA &compiled,
+                                    LexPlan *plan = nullptr);
+
+// Same, with Reps' memoized maximal munch whatever the lookahead (MunchMemo
+// in matcher.h): O(n * states) worst case, one matcher step per byte.
+// Captures are the same as tokenizeWithDFA's.
+std::vector<TokenItem> tokenizeMemoized(const std::string &input, const DFAView &lexer);
+
+// Same, split into chunks lexed on several threads (threads <= 0: one per
+// hardware thread). Chunks start speculatively after whitespace and are lexed
+// again when the previous chunk did not stop there; the result is identical
+// to tokenizeWithDFA. Small inputs are tokenized sequentially.
+std::vector<TokenItem> tokenizeParallel(const std::string &input, const DFAView &lexer, int threads = 0);
+
+// Many independent inputs (e.g. code blocks) at once: up to streams of them
+// (at most MATCH_BATCH_MAX) are lexed in lockstep so their DFA walks overlap,
+// see dfaLongestMatchBatch. out[k] equals tokenizeWithDFA(inputs[k], lexer).
+// A cache-resident lexer gains most from few streams; large tables from 8-16.
+// Tagged lexers fill the captures per lane, as tokenizeWithDFA does.
+std::vector<std::vector<TokenItem>> tokenizeBatch(const std::vector<std::string> &inputs,
+                                                  const DFAView &lexer, int streams = 4);
+
+// Same, with a lazy DFA over buildLexerNFA_thompson() as the matcher
+std::vector<TokenItem> tokenizeWithDFA(const std::string &input, LazyDFA &lexer);
+
+// Same, simulating the token spec's NFA directly (nothing is determinized)
+std::vector<TokenItem> tokenizeWithNFA(const std::string &input, NFASimulator &lexer);
+
+#ifdef CODEBLOCK_DIRECT_SCANNER
+// Same, with the direct-coded scanner scangen generated from the token spec,
+// captures included. Only valid while directScannerSpecHash (direct_scanner.h)
+// is the hashNFASpec of the spec being lexed.
+std::vector<TokenItem> tokenizeDirect(const std::string &input);
+#endif
 
 #endif // TOKENIZER_H
@@ -0,0 +1,13 @@
+#ifndef UNICODE_XID_H
+#define UNICODE_XID_H
+
+#include "utf8.h"
+
+// XID_Start / XID_Continue (UAX #31): the identifier classes of the lexer.
+// Neither includes surrogates; XID_Continue includes '_' and the digits.
+extern const CodePointRange xidStartRanges[];
+extern const int xidStartCount;
+extern const CodePointRange xidContinueRanges[];
+extern const int xidContinueCount;
+
+#endif // UNICODE_XID_H
@@ -0,0 +1,104 @@
+#include "utf8.h"
+#include "unicode_xid.h"
+#include <map>
+#include <tuple>
+
+// One UTF-8 byte-range sequence: byte i of the encoding lies in [lo[i], hi[i]]
+struct Utf8Sequence { int len; uint8_t lo[4], hi[4]; };
+
+int utf8SequenceLength(const unsigned char *p, size_t n) {
+    unsigned char c = p[0];
+    int len;
+    unsigned char min1 = 0x80, max1 = 0xBF; // bounds of the first continuation byte
+    if (c < 0x80) return 1;
+    else if (c >= 0xC2 && c <= 0xDF) len = 2;
+    else if (c >= 0xE0 && c <= 0xEF) { len = 3; if (c == 0xE0) min1 = 0xA0; if (c == 0xED) max1 = 0x9F; }
+    else if (c >= 0xF0 && c <= 0xF4) { len = 4; if (c == 0xF0) min1 = 0x90; if (c == 0xF4) max1 = 0x8F; }
+    else return 1;
+    if ((size_t)len > n || p[1] < min1 || p[1] > max1) return 1;
+    for (int i = 2; i < len; ++i) if (!isUtf8Continuation(p[i])) return 1;
+    return len;
+}
+
+static int encodeUtf8(uint32_t cp, uint8_t out[4]) {
+    if (cp < 0x80) { out[0] = (uint8_t)cp; return 1; }
+    if (cp < 0x800) { out[0] = (uint8_t)(0xC0 | (cp >> 6)); out[1] = (uint8_t)(0x80 | (cp & 0x3F)); return 2; }
+    if (cp < 0x10000) {
+        out[0] = (uint8_t)(0xE0 | (cp >> 12));
+        out[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (uint8_t)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (uint8_t)(0xF0 | (cp >> 18));
+    out[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (uint8_t)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Split [lo, hi] until every piece encodes as a single byte-range sequence:
+// pieces never mix encoded lengths, and below the first differing byte all
+// continuation bytes span their full 0x80..0xBF range
+static void splitRange(uint32_t lo, uint32_t hi, std::vector<Utf8Sequence> &out) {
+    if (lo > hi) return;
+    static const uint32_t lastOfLength[] = { 0x7F, 0x7FF, 0xFFFF };
+    for (uint32_t m : lastOfLength) {
+        if (lo <= m && hi > m) { splitRange(lo, m, out); splitRange(m + 1, hi, out); return; }
+    }
+    if (lo <= 0xDFFF && hi >= 0xD800) { // surrogates have no encoding
+        if (lo < 0xD800) splitRange(lo, 0xD7FF, out);
+        if (hi > 0xDFFF) splitRange(0xE000, hi, out);
+        return;
+    }
+    if (hi > 0x7F) {
+        for (int i = 1; i < 4; ++i) {
+            uint32_t m = (1u << (6 * i)) - 1; // bits held by the last i continuation bytes
+            if ((lo & ~m) == (hi & ~m)) continue;
+            if ((lo & m) != 0) { splitRange(lo, lo | m, out); splitRange((lo | m) + 1, hi, out); return; }
+            if ((hi & m) != m) { splitRange(lo, (hi & ~m) - 1, out); splitRange(hi & ~m, hi, out); return; }
+        }
+    }
+    Utf8Sequence q;
+    q.len = encodeUtf8(lo, q.lo);
+    encodeUtf8(hi, q.hi);
+    out.push_back(q);
+}
+
+Fragment makeCodePointClass(NFA &n, const std::vector<CodePointRange> &ranges) {
+    int s = n.newState();
+    int t = n.newState();
+    std::vector<Utf8Sequence> seqs;
+    for (const CodePointRange &r : ranges) splitRange(r.lo, std::min<uint32_t>(r.hi, 0x10FFFF), seqs);
+
+    // one state per (byte range, next state): sequences share their tails
+    std::map<std::tuple<int, int, int>, int> suffix;
+    for (const Utf8Sequence &q : seqs) {
+        int next = t;
+        for (int i = q.len - 1; i >= 1; --i) {
+            auto key = std::make_tuple((int)q.lo[i], (int)q.hi[i], next);
+            auto it = suffix.find(key);
+            if (it == suffix.end()) {
+                int st = n.newState();
+                for (int b = q.lo[i]; b <= q.hi[i]; ++b) n.addTrans(st, (char)b, next);
+                it = suffix.emplace(key, st).first;
+            }
+            next = it->second;
+        }
+        for (int b = q.lo[0]; b <= q.hi[0]; ++b) n.addTrans(s, (char)b, next);
+    }
+    return {s, t};
+}
+
+// identifier: (XID_Start | '_') XID_Continue*, over UTF-8 bytes
+NFA buildXIDIdentifierNFA_thompson() {
+    NFA n;
+    std::vector<CodePointRange> first(xidStartRanges, xidStartRanges + xidStartCount);
+    first.push_back({ '_', '_' });
+    std::vector<CodePointRange> rest(xidContinueRanges, xidContinueRanges + xidContinueCount);
+    Fragment f1 = makeCodePointClass(n, first);
+    Fragment f2 = makeCodePointClass(n, rest);
+    Fragment full = concatFrag(n, f1, starFrag(n, f2));
+    n.start = full.start;
+    n.accepts.insert(full.accept);
+    return n;
+}
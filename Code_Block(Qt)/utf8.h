@@ -0,0 +1,27 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include "nfa.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Inclusive range of Unicode code points
+struct CodePointRange { uint32_t lo, hi; };
+
+inline bool isUtf8Continuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+// Length of the UTF-8 sequence at p[0..n): 1..4 for a well-formed code point,
+// 1 for a stray or malformed byte (so the caller always makes progress)
+int utf8SequenceLength(const unsigned char *p, size_t n);
+
+// Byte-level automaton for a set of code point ranges: each range is split
+// into UTF-8 byte-range sequences (one per encoded length and continuation
+// boundary) and sequences share their common suffix states. Surrogates and
+// overlong forms are never accepted.
+Fragment makeCodePointClass(NFA &n, const std::vector<CodePointRange> &ranges);
+
+// identifier: (XID_Start | '_') XID_Continue*, over UTF-8 bytes
+NFA buildXIDIdentifierNFA_thompson();
+
+#endif // UTF8_H